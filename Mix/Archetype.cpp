@@ -0,0 +1,205 @@
+#include "Archetype.h"
+#include <new>
+#include <algorithm>
+#include <cstring>
+
+namespace Mix
+{
+
+namespace
+{
+
+std::size_t alignUp(std::size_t offset, std::size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+}
+
+Archetype::Archetype(const ComponentMask &mask, std::pmr::memory_resource *resource) : mask(mask), chunks(resource)
+{
+    columnIndices.resize(BaseComponent::MaxComponents, -1);
+
+    std::size_t rowBytes = sizeof(std::uint32_t);
+    mask.forEach([&](std::size_t componentId) {
+        const auto *info = BaseComponent::getInfo(static_cast<BaseComponent::Id>(componentId));
+        assert(info);
+        columnIndices[componentId] = columns.size();
+        columns.push_back({ static_cast<BaseComponent::Id>(componentId), info, 0 });
+        rowBytes += info->size;
+        chunkAlignment = std::max(chunkAlignment, info->alignment);
+    });
+
+    // lay out the columns for a given number of rows per chunk, returns the number of bytes required
+    auto layout = [this](unsigned int capacity) {
+        std::size_t offset = capacity * sizeof(std::uint32_t);
+        for (auto &column : columns) {
+            offset = alignUp(offset, column.info->alignment);
+            column.offset = offset;
+            offset += capacity * column.info->size;
+        }
+        return offset;
+    };
+
+    // fit as many rows as possible in a chunk (alignment padding might require a few less than the estimate)
+    chunkCapacity = std::max<std::size_t>(CHUNK_SIZE / rowBytes, 1);
+    while (chunkCapacity > 1 && layout(chunkCapacity) > CHUNK_SIZE) {
+        --chunkCapacity;
+    }
+    chunkBytes = layout(chunkCapacity);
+}
+
+Archetype::~Archetype()
+{
+    for (unsigned int row = 0; row < size; ++row) {
+        for (const auto &column : columns) {
+            column.info->destroy(getElement(column, row));
+        }
+    }
+
+    for (auto &chunk : chunks) {
+        chunks.get_allocator().resource()->deallocate(chunk.data, chunkBytes, chunkAlignment);
+    }
+}
+
+unsigned int Archetype::getChunkSize(unsigned int chunk) const
+{
+    assert(chunk < chunks.size());
+    return chunks[chunk].size;
+}
+
+const std::uint32_t* Archetype::getIndices(unsigned int chunk) const
+{
+    return getIndexColumn(chunk);
+}
+
+std::uint32_t Archetype::getIndex(unsigned int row) const
+{
+    assert(row < size);
+    return getIndexColumn(row / chunkCapacity)[row % chunkCapacity];
+}
+
+void* Archetype::getComponent(unsigned int row, BaseComponent::Id componentId)
+{
+    assert(componentId < columnIndices.size() && columnIndices[componentId] >= 0);
+    return getElement(columns[columnIndices[componentId]], row);
+}
+
+unsigned int Archetype::addRow(std::uint32_t index)
+{
+    if (chunks.empty() || chunks.back().size == chunkCapacity) {
+        auto *data = static_cast<unsigned char*>(chunks.get_allocator().resource()->allocate(chunkBytes, chunkAlignment));
+        chunks.push_back({ data, 0 });
+    }
+
+    const auto row = size++;
+    auto &chunk = chunks.back();
+    getIndexColumn(chunks.size() - 1)[chunk.size++] = index;
+    return row;
+}
+
+unsigned int Archetype::addRows(const std::uint32_t *indices, unsigned int count)
+{
+    const auto firstRow = size;
+    for (unsigned int i = 0; i < count; ++i) {
+        addRow(indices[i]);
+    }
+    return firstRow;
+}
+
+void Archetype::fill(BaseComponent::Id componentId, unsigned int firstRow, unsigned int count, const void *value)
+{
+    assert(componentId < columnIndices.size() && columnIndices[componentId] >= 0);
+    assert(firstRow + count <= size);
+    const auto &column = columns[columnIndices[componentId]];
+    const auto elementSize = column.info->size;
+    const auto lastRow = firstRow + count;
+
+    // rows are only contiguous within a chunk
+    for (auto row = firstRow; row < lastRow;) {
+        const auto chunkEnd = std::min((row / chunkCapacity + 1) * chunkCapacity, lastRow);
+        const auto n = chunkEnd - row;
+        auto *destination = static_cast<unsigned char*>(getElement(column, row));
+
+        if (column.info->isTriviallyCopyable) {
+            // copy the value once, then keep doubling the copied range
+            std::memcpy(destination, value, elementSize);
+            for (unsigned int copied = 1; copied < n;) {
+                const auto batch = std::min(copied, n - copied);
+                std::memcpy(destination + copied * elementSize, destination, batch * elementSize);
+                copied += batch;
+            }
+        }
+        else {
+            assert(column.info->copyConstruct && "component type can't be copied");
+            for (unsigned int i = 0; i < n; ++i) {
+                column.info->copyConstruct(destination + i * elementSize, value);
+            }
+        }
+
+        row = chunkEnd;
+    }
+}
+
+void Archetype::copyRow(unsigned int row, unsigned int destinationRow)
+{
+    assert(row < size && destinationRow < size);
+
+    for (const auto &column : columns) {
+        assert(column.info->copyConstruct && "component type can't be copied");
+        column.info->copyConstruct(getElement(column, destinationRow), getElement(column, row));
+    }
+}
+
+void Archetype::moveRow(unsigned int row, Archetype &destination, unsigned int destinationRow)
+{
+    assert(row < size);
+
+    for (const auto &column : columns) {
+        const auto destinationColumn = destination.columnIndices[column.componentId];
+        if (destinationColumn >= 0) {
+            column.info->moveConstruct(destination.getElement(destination.columns[destinationColumn], destinationRow), getElement(column, row));
+        }
+    }
+}
+
+void Archetype::removeRow(unsigned int row)
+{
+    assert(row < size);
+    const auto last = size - 1;
+
+    for (const auto &column : columns) {
+        auto *element = getElement(column, row);
+        column.info->destroy(element);
+
+        if (row != last) {
+            auto *lastElement = getElement(column, last);
+            column.info->moveConstruct(element, lastElement);
+            column.info->destroy(lastElement);
+        }
+    }
+
+    if (row != last) {
+        getIndexColumn(row / chunkCapacity)[row % chunkCapacity] = getIndex(last);
+    }
+
+    --size;
+    if (--chunks.back().size == 0) {
+        chunks.get_allocator().resource()->deallocate(chunks.back().data, chunkBytes, chunkAlignment);
+        chunks.pop_back();
+    }
+}
+
+void* Archetype::getElement(const Column &column, unsigned int row)
+{
+    auto &chunk = chunks[row / chunkCapacity];
+    return chunk.data + column.offset + (row % chunkCapacity) * column.info->size;
+}
+
+std::uint32_t* Archetype::getIndexColumn(unsigned int chunk) const
+{
+    assert(chunk < chunks.size());
+    return reinterpret_cast<std::uint32_t*>(chunks[chunk].data);
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Config.h"
+#include "Component.h"
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+namespace Mix
+{
+
+/*
+    An archetype stores every entity that has exactly the same component mask.
+    Entities (rows) are kept in fixed-size chunks, and each chunk holds one contiguous column per component type,
+    plus a column with the entity index of each row. Rows are always packed: removing a row moves the last row into it.
+    Chunks are allocated from the memory resource given on construction.
+*/
+class Archetype
+{
+public:
+    Archetype(const ComponentMask &mask, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+    ~Archetype();
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    const ComponentMask& getMask() const { return mask; }
+
+    // returns the number of rows (entities)
+    unsigned int getSize() const { return size; }
+
+    /*
+        Chunk access, all rows of a chunk are packed at the start of its columns.
+    */
+    unsigned int getChunkCount() const { return chunks.size(); }
+    unsigned int getChunkCapacity() const { return chunkCapacity; }
+    unsigned int getChunkSize(unsigned int chunk) const;
+    const std::uint32_t* getIndices(unsigned int chunk) const;
+    template <typename T> T* getColumn(unsigned int chunk);
+
+    /*
+        Row access.
+    */
+    std::uint32_t getIndex(unsigned int row) const;
+    void* getComponent(unsigned int row, BaseComponent::Id componentId);
+    template <typename T> T& get(unsigned int row);
+
+    // appends a row for the entity index, the components of the row are left unconstructed
+    unsigned int addRow(std::uint32_t index);
+
+    // appends a row for each of the entity indices and returns the first of the rows (rows are left unconstructed)
+    unsigned int addRows(const std::uint32_t *indices, unsigned int count);
+
+    // copy constructs the value into the component's column for count rows starting at firstRow
+    void fill(BaseComponent::Id componentId, unsigned int firstRow, unsigned int count, const void *value);
+
+    // copy constructs the components of a row into another (unconstructed) row of the archetype
+    void copyRow(unsigned int row, unsigned int destinationRow);
+
+    // move constructs the components of a row into a row of another archetype (only the columns both have in common)
+    void moveRow(unsigned int row, Archetype &destination, unsigned int destinationRow);
+
+    // destroys the components of a row and moves the last row into its place
+    void removeRow(unsigned int row);
+
+    // releases unused memory (chunks themselves are freed as soon as they're empty)
+    void compact() { chunks.shrink_to_fit(); }
+
+private:
+    struct Column
+    {
+        BaseComponent::Id componentId;
+        const ComponentInfo *info;
+        std::size_t offset;
+    };
+
+    struct Chunk
+    {
+        unsigned char *data;
+        unsigned int size;
+    };
+
+    void* getElement(const Column &column, unsigned int row);
+    std::uint32_t* getIndexColumn(unsigned int chunk) const;
+
+    ComponentMask mask;
+
+    // one column per component type, ordered by component id
+    std::vector<Column> columns;
+
+    // component id -> position in columns, or -1 if the archetype doesn't have the component
+    std::vector<int> columnIndices;
+
+    // chunk memory comes from the memory resource of the vector
+    std::pmr::vector<Chunk> chunks;
+    unsigned int chunkCapacity = 0;
+    std::size_t chunkBytes = 0;
+    std::size_t chunkAlignment = alignof(std::uint32_t);
+    unsigned int size = 0;
+};
+
+template <typename T>
+T* Archetype::getColumn(unsigned int chunk)
+{
+    const auto componentId = Component<T>::getId();
+    assert(componentId < columnIndices.size() && columnIndices[componentId] >= 0);
+    assert(chunk < chunks.size());
+    const auto &column = columns[columnIndices[componentId]];
+    return reinterpret_cast<T*>(chunks[chunk].data + column.offset);
+}
+
+template <typename T>
+T& Archetype::get(unsigned int row)
+{
+    return *static_cast<T*>(getComponent(row, Component<T>::getId()));
+}
+
+}
@@ -0,0 +1,180 @@
+#include "CommandBuffer.h"
+#include "World.h"
+#include <algorithm>
+
+namespace Mix
+{
+
+CommandBuffer::CommandBuffer(World &world, std::pmr::memory_resource *resource) : resource(resource), world(world)
+{
+    setThreadCount(1);
+}
+
+CommandBuffer::PendingEntity CommandBuffer::createEntity()
+{
+    auto &threadCommands = getThreadCommands();
+
+    Command command{};
+    command.type = CommandType::Create;
+    command.pending = true;
+    command.pendingEntity = { ThreadPool::getThreadIndex(), threadCommands.pendingCount++ };
+    record(threadCommands, command);
+    return command.pendingEntity;
+}
+
+void CommandBuffer::destroyEntity(Entity e)
+{
+    Command command{};
+    command.type = CommandType::Destroy;
+    command.entity = e;
+    record(getThreadCommands(), command);
+}
+
+void CommandBuffer::destroyEntity(PendingEntity e)
+{
+    Command command{};
+    command.type = CommandType::Destroy;
+    command.pending = true;
+    command.pendingEntity = e;
+    record(getThreadCommands(), command);
+}
+
+void CommandBuffer::playback()
+{
+    auto &entityManager = world.getEntityManager();
+
+    std::pmr::vector<Command> commands(&world.getFrameResource());
+    std::pmr::vector<Command> creates(&world.getFrameResource());
+    for (auto &threadCommands : threads) {
+        for (const auto &command : threadCommands->commands) {
+            (command.type == CommandType::Create ? creates : commands).push_back(command);
+        }
+        threadCommands->createdEntities.resize(threadCommands->pendingCount);
+    }
+
+    // create the pending entities all at once, in an order that doesn't depend on which thread recorded them
+    std::sort(creates.begin(), creates.end(), [](const Command &a, const Command &b) {
+        if (a.key != b.key) {
+            return a.key < b.key;
+        }
+        return a.thread != b.thread ? a.thread < b.thread : a.sequence < b.sequence;
+    });
+
+    if (!creates.empty()) {
+        const auto entities = world.createEntities(creates.size());
+        for (std::size_t i = 0; i < creates.size(); ++i) {
+            const auto &pendingEntity = creates[i].pendingEntity;
+            threads[pendingEntity.thread]->createdEntities[pendingEntity.index] = entities[i];
+        }
+    }
+
+    for (auto &command : commands) {
+        if (command.pending) {
+            command.entity = getEntity(command.pendingEntity);
+        }
+    }
+
+    // group the commands per entity, and per component within an entity (a destroy comes last), in recording order
+    std::sort(commands.begin(), commands.end(), [](const Command &a, const Command &b) {
+        if (a.entity.getIndex() != b.entity.getIndex()) {
+            return a.entity.getIndex() < b.entity.getIndex();
+        }
+        if (a.entity.getVersion() != b.entity.getVersion()) {
+            return a.entity.getVersion() < b.entity.getVersion();
+        }
+        const auto aDestroy = a.type == CommandType::Destroy;
+        const auto bDestroy = b.type == CommandType::Destroy;
+        if (aDestroy != bDestroy) {
+            return bDestroy;
+        }
+        if (a.componentId != b.componentId) {
+            return a.componentId < b.componentId;
+        }
+        if (a.key != b.key) {
+            return a.key < b.key;
+        }
+        return a.thread != b.thread ? a.thread < b.thread : a.sequence < b.sequence;
+    });
+
+    auto sameEntity = [](const Command &a, const Command &b) {
+        return a.entity.getIndex() == b.entity.getIndex() && a.entity.getVersion() == b.entity.getVersion();
+    };
+
+    for (std::size_t first = 0; first < commands.size();) {
+        auto last = first + 1;
+        while (last < commands.size() && sameEntity(commands[first], commands[last])) {
+            ++last;
+        }
+
+        const auto e = commands[first].entity;
+        if (!entityManager.isEntityAlive(e)) {
+            first = last;
+            continue;
+        }
+
+        // a destroyed entity's component changes don't matter
+        if (commands[last - 1].type == CommandType::Destroy) {
+            world.destroyEntity(e);
+            first = last;
+            continue;
+        }
+
+        // only the last add/remove of each component is applied
+        for (auto i = first; i < last; ++i) {
+            const auto &command = commands[i];
+            if (i + 1 < last && commands[i + 1].componentId == command.componentId) {
+                continue;
+            }
+
+            auto &componentValues = *threads[command.thread]->componentValues[command.componentId];
+            if (command.type == CommandType::Add) {
+                componentValues.add(entityManager, e, command.valueIndex);
+            }
+            else {
+                componentValues.remove(entityManager, e);
+            }
+        }
+
+        first = last;
+    }
+
+    for (auto &threadCommands : threads) {
+        threadCommands->commands.clear();
+        threadCommands->pendingCount = 0;
+        for (auto &componentValues : threadCommands->componentValues) {
+            if (componentValues) {
+                componentValues->clear();
+            }
+        }
+    }
+}
+
+Entity CommandBuffer::getEntity(PendingEntity e) const
+{
+    assert(e.thread < threads.size() && e.index < threads[e.thread]->createdEntities.size());
+    return threads[e.thread]->createdEntities[e.index];
+}
+
+void CommandBuffer::setThreadCount(unsigned int threadCount)
+{
+    while (threads.size() < threadCount) {
+        threads.emplace_back(new ThreadCommands(resource));
+    }
+}
+
+CommandBuffer::ThreadCommands& CommandBuffer::getThreadCommands()
+{
+    const auto threadIndex = ThreadPool::getThreadIndex();
+    assert(threadIndex < threads.size());
+    return *threads[threadIndex];
+}
+
+void CommandBuffer::record(ThreadCommands &threadCommands, Command command)
+{
+    command.key = EventManager::getEmitKey();
+    command.thread = ThreadPool::getThreadIndex();
+    command.sequence = threadCommands.commands.size();
+    threadCommands.commands.push_back(command);
+}
+
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Config.h"
+#include "Component.h"
+#include "Entity.h"
+#include "Pool.h"
+#include "ThreadPool.h"
+#include "Event.h"
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <cstdint>
+#include <cassert>
+
+namespace Mix
+{
+
+class World;
+
+/*
+    Records structural changes (creating/destroying entities, adding/removing components) to apply them later,
+    so that systems don't invalidate the components they (or other systems running at the same time) are iterating.
+    World::update plays the commands back before it updates the systems' entity lists.
+
+    Every thread records into a buffer of its own without locking. Playback sorts the commands per entity and coalesces them:
+    an entity that is destroyed only gets destroyed, and for each component only the last add/remove is applied.
+    Commands on the same entity are ordered by emit key (see EventManager::EmitScope), i.e. by system and parallelEach batch.
+
+    Example:
+
+    // inside parallelEach
+    auto &commands = getWorld().getCommandBuffer();
+    auto bullet = commands.createEntity();
+    commands.addComponent<PositionComponent>(bullet, position.x, position.y);
+    commands.removeComponent<VelocityComponent>(e);
+*/
+class CommandBuffer
+{
+public:
+    // An entity that will be created on playback, commands can target it before it exists.
+    struct PendingEntity
+    {
+        std::uint32_t thread;
+        std::uint32_t index;
+    };
+
+    // the recorded commands are stored in memory from the memory resource (which must be thread-safe if commands are recorded concurrently)
+    CommandBuffer(World &world, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    PendingEntity createEntity();
+    void destroyEntity(Entity e);
+    void destroyEntity(PendingEntity e);
+
+    template <typename T, typename ... Args>
+    void addComponent(Entity e, Args && ... args);
+
+    template <typename T, typename ... Args>
+    void addComponent(PendingEntity e, Args && ... args);
+
+    template <typename T>
+    void removeComponent(Entity e);
+
+    template <typename T>
+    void removeComponent(PendingEntity e);
+
+    // applies and clears the recorded commands (called by World::update, must not be called while commands are recorded)
+    void playback();
+
+    // returns the entity a pending entity became during the last playback (if it was destroyed by a command too, it's destroyed on that update)
+    Entity getEntity(PendingEntity e) const;
+
+    // makes room for threads with thread index (see ThreadPool::getThreadIndex) below threadCount to record commands
+    void setThreadCount(unsigned int threadCount);
+
+private:
+    enum class CommandType : std::uint8_t
+    {
+        Create,
+        Add,
+        Remove,
+        Destroy
+    };
+
+    struct Command
+    {
+        CommandType type;
+        bool pending;                   // whether the target is a pending entity
+        BaseComponent::Id componentId;
+        Entity entity;                  // the target if it's not pending
+        PendingEntity pendingEntity;    // the target if it's pending
+        std::uint32_t valueIndex;       // Add: where the component value is stored
+        std::uint64_t key;              // emit key of the recording thread
+        std::uint32_t thread;           // thread index of the recording thread
+        std::uint32_t sequence;         // position in the thread's commands
+    };
+
+    // the component values of one type recorded by a thread, and how to apply them (type-erased)
+    class BaseComponentValues
+    {
+    public:
+        virtual ~BaseComponentValues() {}
+        virtual void add(EntityManager &entityManager, Entity e, std::uint32_t index) = 0;
+        virtual void remove(EntityManager &entityManager, Entity e) = 0;
+        virtual void clear() = 0;
+    };
+
+    template <typename T>
+    class ComponentValues : public BaseComponentValues
+    {
+    public:
+        ComponentValues(std::pmr::memory_resource *resource) : values(resource) {}
+
+        void add(EntityManager &entityManager, Entity e, std::uint32_t index)
+        {
+            entityManager.addComponent<T, T>(e, std::move(values[index]));
+        }
+
+        void remove(EntityManager &entityManager, Entity e)
+        {
+            entityManager.removeComponent<T>(e);
+        }
+
+        void clear()
+        {
+            values.clear();
+        }
+
+        Pool<T> values;
+    };
+
+    // aligned so that threads recording into their own buffers don't share cache lines
+    struct alignas(CACHE_LINE_SIZE) ThreadCommands
+    {
+        ThreadCommands(std::pmr::memory_resource *resource) : commands(resource), createdEntities(resource) {}
+
+        std::pmr::vector<Command> commands;
+
+        // vector index = component id
+        std::vector<std::unique_ptr<BaseComponentValues>> componentValues;
+
+        std::uint32_t pendingCount = 0;
+
+        // vector index = pending entity index, what the pending entities became during the last playback
+        std::pmr::vector<Entity> createdEntities;
+    };
+
+    ThreadCommands& getThreadCommands();
+
+    template <typename T>
+    ComponentValues<T>& accommodateComponentValues(ThreadCommands &threadCommands);
+
+    template <typename T, typename ... Args>
+    void recordAdd(Command command, Args && ... args);
+
+    template <typename T>
+    void recordRemove(Command command);
+
+    void record(ThreadCommands &threadCommands, Command command);
+
+    // vector index = thread index
+    std::vector<std::unique_ptr<ThreadCommands>> threads;
+
+    std::pmr::memory_resource *resource;
+
+    World &world;
+};
+
+template <typename T, typename ... Args>
+void CommandBuffer::addComponent(Entity e, Args && ... args)
+{
+    Command command{};
+    command.entity = e;
+    recordAdd<T>(command, std::forward<Args>(args) ...);
+}
+
+template <typename T, typename ... Args>
+void CommandBuffer::addComponent(PendingEntity e, Args && ... args)
+{
+    Command command{};
+    command.pending = true;
+    command.pendingEntity = e;
+    recordAdd<T>(command, std::forward<Args>(args) ...);
+}
+
+template <typename T>
+void CommandBuffer::removeComponent(Entity e)
+{
+    Command command{};
+    command.entity = e;
+    recordRemove<T>(command);
+}
+
+template <typename T>
+void CommandBuffer::removeComponent(PendingEntity e)
+{
+    Command command{};
+    command.pending = true;
+    command.pendingEntity = e;
+    recordRemove<T>(command);
+}
+
+template <typename T>
+CommandBuffer::ComponentValues<T>& CommandBuffer::accommodateComponentValues(ThreadCommands &threadCommands)
+{
+    const auto componentId = Component<T>::getId();
+    auto &componentValues = threadCommands.componentValues;
+
+    if (componentId >= componentValues.size()) {
+        componentValues.resize(componentId + 1);
+    }
+
+    if (!componentValues[componentId]) {
+        componentValues[componentId].reset(new ComponentValues<T>(resource));
+    }
+
+    return static_cast<ComponentValues<T>&>(*componentValues[componentId]);
+}
+
+template <typename T, typename ... Args>
+void CommandBuffer::recordAdd(Command command, Args && ... args)
+{
+    auto &threadCommands = getThreadCommands();
+    auto &values = accommodateComponentValues<T>(threadCommands).values;
+
+    command.type = CommandType::Add;
+    command.componentId = Component<T>::getId();
+    command.valueIndex = values.getSize();
+    values.emplace(std::forward<Args>(args) ...);
+    record(threadCommands, command);
+}
+
+template <typename T>
+void CommandBuffer::recordRemove(Command command)
+{
+    auto &threadCommands = getThreadCommands();
+    accommodateComponentValues<T>(threadCommands);
+
+    command.type = CommandType::Remove;
+    command.componentId = Component<T>::getId();
+    record(threadCommands, command);
+}
+
+}
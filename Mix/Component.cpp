@@ -3,6 +3,21 @@
 namespace Mix
 {
 
-BaseComponent::Id BaseComponent::nextId = 0;
+TypeRegistry& BaseComponent::getRegistry()
+{
+    static TypeRegistry registry(MaxComponents, RESERVED_COMPONENT_IDS);
+    return registry;
+}
+
+const ComponentInfo* BaseComponent::getInfo(Id id)
+{
+    return static_cast<const ComponentInfo*>(getRegistry().get(id));
+}
+
+BaseComponent::Id BaseComponent::findId(const char *name)
+{
+    const auto id = getRegistry().find(TypeInfo::hash(name));
+    return id == TypeRegistry::NoId ? MaxComponents : Id(id);
+}
 
 }
@@ -1,7 +1,12 @@
 #pragma once
 
 #include "Config.h"
-#include <bitset>
+#include "TypeRegistry.h"
+#include <new>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
 #include <cstdint>
 #include <cassert>
 
@@ -13,35 +18,237 @@ namespace Mix
 
     struct PositionComponent
     {
-        // important that we have a default constructor (i.e. no args required) in order for the creation of components to work
-        PositionComponent(float x = 0.0f, float y = 0.0f) : x(x), y(y) {}
+        PositionComponent(float x, float y) : x(x), y(y) {}
         float x, y;
     };
+
+    Components are constructed in place from the arguments given to addComponent, so no default constructor is required.
+    They must be move constructible and move assignable (storage moves components around to keep them packed).
 */
 
+// Describes a component type to storage that keeps components as raw bytes (i.e. archetype chunks).
+struct ComponentInfo : TypeInfo
+{
+    // move constructs an object at destination from the object at source (source still has to be destroyed)
+    void (*moveConstruct)(void *destination, void *source);
+
+    // copy constructs an object at destination from the object at source (null if T can't be copied)
+    void (*copyConstruct)(void *destination, const void *source);
+
+    // calls the destructor of the object
+    void (*destroy)(void *object);
+
+    // Returns the info of component type T
+    template <typename T>
+    static const ComponentInfo& get()
+    {
+        static const ComponentInfo info = {
+            TypeInfo::make<T, ComponentTraits<T>>(),
+            [](void *destination, void *source) { new (destination) T(std::move(*static_cast<T*>(source))); },
+            getCopyConstruct<T>(),
+            [](void *object) { static_cast<T*>(object)->~T(); }
+        };
+        return info;
+    }
+
+private:
+    template <typename T>
+    static auto getCopyConstruct() -> void (*)(void*, const void*)
+    {
+        if constexpr (std::is_copy_constructible<T>::value) {
+            return [](void *destination, const void *source) { new (destination) T(*static_cast<const T*>(source)); };
+        }
+        else {
+            return nullptr;
+        }
+    }
+};
+
 // Used to be able to assign unique ids to each component type.
 struct BaseComponent
 {
-    using Id = uint8_t;
+    using Id = uint16_t;
     static const Id MaxComponents = MAX_COMPONENTS;
+    static_assert(MAX_COMPONENTS > 0 && MAX_COMPONENTS <= 65535, "MAX_COMPONENTS doesn't fit in a component id");
+    static_assert(RESERVED_COMPONENT_IDS <= MAX_COMPONENTS, "more reserved component ids than component ids");
+
+    // returns the info of the component type with the id, null if no component type has that id (yet)
+    static const ComponentInfo* getInfo(Id id);
+
+    // returns the id of the component type with the name (see ComponentTraits), MaxComponents if no such type has been used yet
+    static Id findId(const char *name);
+
 protected:
-    static Id nextId;
+    static TypeRegistry& getRegistry();
 };
 
-// Used to assign a unique id to a component type, we don't really have to make our components derive from this though.
+/*
+    Used to assign a unique id to a component type, we don't really have to make our components derive from this though.
+    The id is fixed if the type's ComponentTraits give one, otherwise it's assigned on first use (thread-safe).
+*/
 template <typename T>
 struct Component : BaseComponent
 {
     // Returns the unique id of Component<T>
     static Id getId()
     {
-        static auto id = nextId++;
-        assert(id < MaxComponents);
+        static const auto id = Id(getRegistry().add<ComponentTraits<T>>(ComponentInfo::get<T>()));
         return id;
     }
 };
 
-// Used to keep track of which components an entity has and also which entities a system is interested in.
-using ComponentMask = std::bitset<BaseComponent::MaxComponents>;
+/*
+    Used to keep track of which components an entity has and also which entities a system is interested in.
+    A fixed size set of MaxComponents bits stored in 64-bit words. The word count is a compile-time constant and the operations
+    go over every word without early exits, so the compiler unrolls and vectorizes them (e.g. a 256-bit mask is one AVX register).
+*/
+class ComponentMask
+{
+public:
+    using Word = std::uint64_t;
+    static const unsigned int WordBits = 64;
+    static const unsigned int WordCount = (BaseComponent::MaxComponents + WordBits - 1) / WordBits;
+
+    ComponentMask() : words() {}
+
+    std::size_t size() const { return BaseComponent::MaxComponents; }
+
+    bool test(std::size_t bit) const
+    {
+        assert(bit < size());
+        return (words[bit / WordBits] >> (bit % WordBits)) & 1;
+    }
+
+    ComponentMask& set(std::size_t bit, bool value = true)
+    {
+        assert(bit < size());
+        const auto flag = Word(1) << (bit % WordBits);
+        words[bit / WordBits] = value ? (words[bit / WordBits] | flag) : (words[bit / WordBits] & ~flag);
+        return *this;
+    }
+
+    ComponentMask& reset(std::size_t bit) { return set(bit, false); }
+
+    ComponentMask& reset()
+    {
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            words[i] = 0;
+        }
+        return *this;
+    }
+
+    bool any() const
+    {
+        Word bits = 0;
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            bits |= words[i];
+        }
+        return bits != 0;
+    }
+
+    bool none() const { return !any(); }
+
+    // returns true if every bit set in mask is set in this mask too (i.e. an entity with this mask matches a system with that mask)
+    bool includes(const ComponentMask &mask) const
+    {
+        Word missing = 0;
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            missing |= mask.words[i] & ~words[i];
+        }
+        return missing == 0;
+    }
+
+    // returns true if a bit is set in both masks
+    bool intersects(const ComponentMask &mask) const
+    {
+        Word shared = 0;
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            shared |= mask.words[i] & words[i];
+        }
+        return shared != 0;
+    }
+
+    // calls f(componentId) for each set bit, in ascending order
+    template <typename F>
+    void forEach(F &&f) const
+    {
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            for (auto word = words[i]; word != 0; word &= word - 1) {
+                f(std::size_t(i * WordBits + lowestBit(word)));
+            }
+        }
+    }
+
+    std::size_t hash() const
+    {
+        std::size_t seed = 0;
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            seed ^= std::hash<Word>()(words[i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+
+    ComponentMask& operator&=(const ComponentMask &mask)
+    {
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            words[i] &= mask.words[i];
+        }
+        return *this;
+    }
+
+    ComponentMask& operator|=(const ComponentMask &mask)
+    {
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            words[i] |= mask.words[i];
+        }
+        return *this;
+    }
+
+    friend ComponentMask operator&(ComponentMask a, const ComponentMask &b) { return a &= b; }
+    friend ComponentMask operator|(ComponentMask a, const ComponentMask &b) { return a |= b; }
+
+    bool operator==(const ComponentMask &mask) const
+    {
+        Word different = 0;
+        for (unsigned int i = 0; i < WordCount; ++i) {
+            different |= mask.words[i] ^ words[i];
+        }
+        return different == 0;
+    }
+
+    bool operator!=(const ComponentMask &mask) const { return !(*this == mask); }
+
+private:
+    // index of the lowest set bit (word must not be 0)
+    static unsigned int lowestBit(Word word)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(word);
+#else
+        unsigned int bit = 0;
+        for (; !(word & 1); word >>= 1) {
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    Word words[WordCount];
+};
+
+
+}
+
+namespace std
+{
+
+template <>
+struct hash<Mix::ComponentMask>
+{
+    std::size_t operator()(const Mix::ComponentMask &mask) const
+    {
+        return mask.hash();
+    }
+};
 
 }
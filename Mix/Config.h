@@ -5,11 +5,26 @@ namespace Mix
 
 enum
 {
-    MAX_COMPONENTS   = 64,
+    MAX_COMPONENTS   = 256,
+    MAX_EVENTS       = 256,
+    RESERVED_COMPONENT_IDS = 0,
+    RESERVED_EVENT_IDS = 0,
     INDEX_BITS       = 24,
     VERSION_BITS     = 8,
     MINIMUM_FREE_IDS = 1024,
-    DEFAULT_POOL_SIZE = 100
+    DEFAULT_POOL_SIZE = 100,
+    SPARSE_PAGE_SIZE = 4096,
+    ENTITY_PAGE_SIZE = 4096,
+    FREE_ID_QUEUE_SIZE = 16384,
+    CHUNK_SIZE = 16384,
+    COMPONENT_PAGE_SIZE = 1024,
+    PAGED_COMPONENT_POOLS = 0,
+    FRAME_ARENA_SIZE = 65536,
+    PROFILING = 0,
+    PROFILER_BUFFER_SIZE = 16384,
+    WORKER_THREADS = 0,
+    CACHE_LINE_SIZE = 64,
+    DEFAULT_GRAIN_SIZE = 1024
 };
 
 }
@@ -1,105 +1,397 @@
 #include "Entity.h"
+#include "Prefab.h"
 #include "World.h"
+#include <algorithm>
 #include <cassert>
 
 namespace Mix
 {
 
-void Entity::kill()
+std::string Entity::toString() const
 {
-    getEntityManager().killEntity(*this);
+    std::string s = "entity id: " + std::to_string(getIndex()) + ", version: " + std::to_string(getVersion());
+    return s;
 }
 
-bool Entity::isAlive() const
+void EntityRef::kill()
 {
-    return getEntityManager().isEntityAlive(*this);
+    entityManager->killEntity(entity);
 }
 
-void Entity::tag(std::string tag)
+bool EntityRef::isAlive() const
 {
-    getEntityManager().tagEntity(*this, tag);
+    return entityManager->isEntityAlive(entity);
 }
 
-bool Entity::hasTag(std::string tag) const
+void EntityRef::tag(Symbol tag)
 {
-    return getEntityManager().hasTaggedEntity(tag, *this);
+    entityManager->tagEntity(entity, tag);
 }
 
-void Entity::group(std::string group)
+bool EntityRef::hasTag(Symbol tag) const
 {
-    getEntityManager().groupEntity(*this, group);
+    return entityManager->hasTaggedEntity(tag, entity);
 }
 
-bool Entity::hasGroup(std::string group) const
+void EntityRef::group(Symbol group)
 {
-    return getEntityManager().hasEntityInGroup(group, *this);
+    entityManager->groupEntity(entity, group);
 }
 
-std::string Entity::toString() const
+void EntityRef::ungroup(Symbol group)
 {
-    std::string s = "entity id: " + std::to_string(getIndex()) + ", version: " + std::to_string(getVersion());
-    return s;
+    entityManager->ungroupEntity(entity, group);
+}
+
+bool EntityRef::hasGroup(Symbol group) const
+{
+    return entityManager->hasEntityInGroup(group, entity);
+}
+
+EntityIdAllocator::EntityIdAllocator() : directories(new std::atomic<Directory*>[DirectoryCount]), freeQueue(new std::atomic<Entity::Index>[QueueSize])
+{
+    for (unsigned int i = 0; i < DirectoryCount; ++i) {
+        directories[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+EntityIdAllocator::~EntityIdAllocator()
+{
+    for (unsigned int i = 0; i < DirectoryCount; ++i) {
+        auto *directory = directories[i].load(std::memory_order_relaxed);
+        if (!directory) {
+            continue;
+        }
+
+        for (unsigned int page = 0; page < PagesPerDirectory; ++page) {
+            delete[] directory[page].load(std::memory_order_relaxed);
+        }
+        delete[] directory;
+    }
+}
+
+Entity::Index EntityIdAllocator::allocate()
+{
+    Entity::Index index;
+    return reuse(index) ? index : allocateFresh();
+}
+
+bool EntityIdAllocator::reuse(Entity::Index &index)
+{
+    auto head = freeHead.load(std::memory_order_acquire);
+
+    for (;;) {
+        const auto tail = freeTail.load(std::memory_order_acquire);
+        if (tail - head <= MINIMUM_FREE_IDS) {
+            return false;
+        }
+
+        // read the slot before claiming it, once claimed the freeing thread may overwrite it
+        index = freeQueue[head % QueueSize].load(std::memory_order_relaxed);
+        if (freeHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+}
+
+Entity::Index EntityIdAllocator::allocateFresh(unsigned int count)
+{
+    const auto first = size.fetch_add(count, std::memory_order_acq_rel);
+    assert(first + count <= IndexCount);
+    accommodateVersions(first, first + count);
+    return Entity::Index(first);
+}
+
+void EntityIdAllocator::free(Entity::Index index)
+{
+    auto *version = findVersion(index);
+    assert(version);
+    version->store((version->load(std::memory_order_relaxed) + 1) & Entity::VersionMask, std::memory_order_release);
+
+    drainOverflow();
+
+    const auto tail = freeTail.load(std::memory_order_relaxed);
+    if (!overflow.empty() || tail - freeHead.load(std::memory_order_acquire) >= QueueSize) {
+        overflow.push_back(index);
+        return;
+    }
+
+    freeQueue[tail % QueueSize].store(index, std::memory_order_relaxed);
+    freeTail.store(tail + 1, std::memory_order_release);
+}
+
+bool EntityIdAllocator::isAlive(Entity::Index index, Entity::Version version) const
+{
+    const auto *current = findVersion(index);
+    return current && current->load(std::memory_order_acquire) == version;
+}
+
+Entity::Version EntityIdAllocator::getVersion(Entity::Index index) const
+{
+    // size is bumped before the pages of the fresh indices are published, so another thread might see an index below
+    // the size whose page doesn't exist yet, that index has never been handed out (its version is 0)
+    const auto *version = findVersion(index);
+    return version ? version->load(std::memory_order_acquire) : 0;
+}
+
+EntityIdAllocator::Version* EntityIdAllocator::findVersion(Entity::Index index) const
+{
+    const auto page = index / PageSize;
+    if (page >= PageCount) {
+        return nullptr;
+    }
+
+    const auto *directory = directories[page / PagesPerDirectory].load(std::memory_order_acquire);
+    if (!directory) {
+        return nullptr;
+    }
+
+    auto *versions = directory[page % PagesPerDirectory].load(std::memory_order_acquire);
+    return versions ? &versions[index % PageSize] : nullptr;
 }
 
-EntityManager& Entity::getEntityManager() const
+void EntityIdAllocator::accommodateVersions(std::uint64_t first, std::uint64_t last)
+{
+    if (first == last) {
+        return;
+    }
+
+    // threads allocating indices in the same new directory/page race to publish it, the losers free theirs
+    for (auto page = first / PageSize; page <= (last - 1) / PageSize; ++page) {
+        auto &directorySlot = directories[page / PagesPerDirectory];
+        auto *directory = directorySlot.load(std::memory_order_acquire);
+        if (!directory) {
+            std::unique_ptr<Directory[]> created(new Directory[PagesPerDirectory]);
+            for (unsigned int i = 0; i < PagesPerDirectory; ++i) {
+                created[i].store(nullptr, std::memory_order_relaxed);
+            }
+
+            if (directorySlot.compare_exchange_strong(directory, created.get(), std::memory_order_acq_rel)) {
+                directory = created.release();
+            }
+        }
+
+        auto &pageSlot = directory[page % PagesPerDirectory];
+        if (pageSlot.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        std::unique_ptr<Version[]> versions(new Version[PageSize]);
+        for (unsigned int i = 0; i < PageSize; ++i) {
+            versions[i].store(0, std::memory_order_relaxed);
+        }
+
+        Version *expected = nullptr;
+        if (pageSlot.compare_exchange_strong(expected, versions.get(), std::memory_order_acq_rel)) {
+            versions.release();
+        }
+    }
+}
+
+std::uint64_t EntityIdAllocator::getUsedSize() const
+{
+    const auto head = freeHead.load(std::memory_order_acquire);
+    const auto tail = freeTail.load(std::memory_order_acquire);
+
+    std::vector<Entity::Index> freeIndices;
+    freeIndices.reserve(tail - head + overflow.size());
+    for (auto position = head; position < tail; ++position) {
+        freeIndices.push_back(freeQueue[position % QueueSize].load(std::memory_order_relaxed));
+    }
+    freeIndices.insert(freeIndices.end(), overflow.begin(), overflow.end());
+
+    // walk down from the end of the handed out range for as long as the indices are free
+    std::sort(freeIndices.begin(), freeIndices.end());
+    auto usedSize = size.load(std::memory_order_relaxed);
+    while (!freeIndices.empty() && freeIndices.back() + 1 == usedSize) {
+        freeIndices.pop_back();
+        --usedSize;
+    }
+
+    return usedSize;
+}
+
+void EntityIdAllocator::drainOverflow()
+{
+    auto tail = freeTail.load(std::memory_order_relaxed);
+    const auto head = freeHead.load(std::memory_order_acquire);
+
+    while (!overflow.empty() && tail - head < QueueSize) {
+        freeQueue[tail % QueueSize].store(overflow.front(), std::memory_order_relaxed);
+        overflow.pop_front();
+        ++tail;
+    }
+
+    freeTail.store(tail, std::memory_order_release);
+}
+
+EntityManager::EntityManager(World &world, StorageMode storageMode, std::pmr::memory_resource *resource)
+    : storageMode(storageMode), componentMasks(resource), versions(resource), changedEntities(resource), changedPositions(resource),
+      entityLocations(resource), taggedEntities(resource), entityTags(resource), groups(resource), entityGroups(resource),
+      resource(resource), world(world)
 {
-    assert(entityManager != nullptr);
-    return *entityManager;
 }
 
 Entity EntityManager::createEntity()
 {
-    Entity::Id index;
+    return getEntity(ids.allocate());
+}
+
+void EntityManager::createEntities(unsigned int count, std::vector<Entity> &entities)
+{
+    entities.reserve(entities.size() + count);
 
-    if (freeIds.size() > MinimumFreeIds) {
-        index = freeIds.front();
-        freeIds.pop_front();
+    // reuse free indices first (keeping the minimum amount of them around)
+    Entity::Index index;
+    while (count > 0 && ids.reuse(index)) {
+        entities.push_back(getEntity(index));
+        --count;
     }
-    else {
-        versions.push_back(0);
-        index = (unsigned int)versions.size() - 1;
-        assert(index < (1 << Entity::IndexBits));
 
-        if (index >= componentMasks.size()) {
-            // TODO: grow by doubling?
-            componentMasks.resize(index + 1);
+    if (count == 0) {
+        return;
+    }
+
+    // then reserve fresh indices in one go for the rest
+    const auto first = ids.allocateFresh(count);
+    for (auto index = first; index < first + count; ++index) {
+        entities.push_back(getEntity(index));
+    }
+}
+
+void EntityManager::createEntities(unsigned int count, Entity prototype, std::vector<Entity> &entities)
+{
+    const auto start = entities.size();
+    createEntities(count, entities);
+    if (count > 0) {
+        accommodateEntity(ids.getSize() - 1);
+    }
+    copyComponents(prototype, entities.data() + start, entities.data() + entities.size());
+}
+
+void EntityManager::instantiate(const Prefab &prefab, unsigned int count, std::vector<Entity> &entities)
+{
+    const auto start = entities.size();
+    createEntities(count, entities);
+    if (count > 0) {
+        accommodateEntity(ids.getSize() - 1);
+    }
+
+    const auto &prefabMask = prefab.getComponentMask();
+    std::pmr::vector<std::uint32_t> indices(&world.getFrameResource());
+    indices.reserve(count);
+    for (auto i = start; i < entities.size(); ++i) {
+        indices.push_back(entities[i].getIndex());
+        componentMasks[indices.back()] = prefabMask;
+    }
+
+    if (storageMode == StorageMode::Archetype) {
+        if (prefabMask.none()) {
+            return;
+        }
+
+        // the new rows are contiguous, so each column is filled in one go
+        auto &archetype = getArchetype(prefabMask);
+        const auto firstRow = archetype.addRows(indices.data(), count);
+        for (unsigned int i = 0; i < count; ++i) {
+            entityLocations[indices[i]] = { &archetype, firstRow + i };
+        }
+
+        for (const auto &component : prefab.components) {
+            archetype.fill(component->componentId, firstRow, count, component->getValue());
         }
+        return;
     }
 
-    assert(index < versions.size());
-    Entity e(index, versions[index]);
-    e.entityManager = this;
+    // one pass per component type, so each pool only grows once
+    for (const auto &component : prefab.components) {
+        component->fill(*this, indices.data(), count);
+    }
+}
 
-    return e;
+void EntityManager::destroyEntities(const Entity *first, const Entity *last)
+{
+    for (auto it = first; it != last; ++it) {
+        destroyEntity(*it);
+    }
+}
+
+void EntityManager::copyComponents(Entity prototype, const Entity *first, const Entity *last)
+{
+    const auto prototypeIndex = prototype.getIndex();
+    if (prototypeIndex >= componentMasks.size()) {
+        return;
+    }
+    const auto prototypeMask = componentMasks[prototypeIndex];
+
+    if (storageMode == StorageMode::Archetype) {
+        const auto prototypeLocation = entityLocations[prototypeIndex];
+        if (!prototypeLocation.archetype) {
+            return;
+        }
+
+        auto &archetype = *prototypeLocation.archetype;
+        for (auto it = first; it != last; ++it) {
+            const auto index = it->getIndex();
+            assert(componentMasks[index].none());
+            const auto row = archetype.addRow(index);
+            archetype.copyRow(prototypeLocation.row, row);
+            entityLocations[index] = { &archetype, row };
+            componentMasks[index] = prototypeMask;
+        }
+        return;
+    }
+
+    std::pmr::vector<std::uint32_t> indices(&world.getFrameResource());
+    indices.reserve(last - first);
+    for (auto it = first; it != last; ++it) {
+        assert(componentMasks[it->getIndex()].none());
+        indices.push_back(it->getIndex());
+        componentMasks[it->getIndex()] = prototypeMask;
+    }
+
+    // one pass per component type, so each pool only grows once
+    prototypeMask.forEach([&](std::size_t componentId) {
+        componentPools[componentId]->copy(prototypeIndex, indices.data(), indices.size());
+    });
 }
 
 void EntityManager::destroyEntity(Entity e)
 {
     const auto index = e.getIndex();
-    assert(index < versions.size());        // sanity check
-    assert(index < componentMasks.size());
-    ++versions[index];                      // increase the version for that id
-    freeIds.push_back(index);               // make the id available for reuse
-    componentMasks[index].reset();          // reset the component mask for that id
+    assert(isEntityAlive(e));
+    accommodateEntity(index);
+    ids.free(index);                        // increase the version for that id and make the id available for reuse
+    versions[index] = ids.getVersion(index);
+
+    // drop the entity's components from their pools (or archetype) and reset the component mask for that id
+    auto &componentMask = componentMasks[index];
+    if (storageMode == StorageMode::Archetype) {
+        auto &location = entityLocations[index];
+        if (location.archetype) {
+            removeEntityRow(*location.archetype, location.row);
+        }
+        location = EntityLocation();
+    }
+    else {
+        componentMask.forEach([&](std::size_t componentId) {
+            componentPools[componentId]->remove(index);
+        });
+    }
+    componentMask.reset();
 
     // if tagged, remove entity from tag management
-    auto taggedEntity = entityTags.find(e.id);
+    auto taggedEntity = entityTags.find(index);
     if (taggedEntity != entityTags.end()) {
-        auto tag = taggedEntity->second;
-        taggedEntities.erase(tag);
+        taggedEntities.erase(taggedEntity->second);
         entityTags.erase(taggedEntity);
     }
 
-    // if in group, remove entity from group management
-    auto groupedEntity = entityGroups.find(e.id);
+    // if in groups, remove entity from them
+    auto groupedEntity = entityGroups.find(index);
     if (groupedEntity != entityGroups.end()) {
-        auto groupName = groupedEntity->second;
-        auto group = groupedEntities.find(groupName);
-        if (group != groupedEntities.end()) {
-            auto entityInGroup = group->second.find(e);
-            if (entityInGroup != group->second.end()) {
-                group->second.erase(entityInGroup);
-            }
+        for (auto group : groupedEntity->second) {
+            removeFromGroup(*groups.find(group)->second, e);
         }
         entityGroups.erase(groupedEntity);
     }
@@ -107,57 +399,188 @@ void EntityManager::destroyEntity(Entity e)
 
 void EntityManager::killEntity(Entity e)
 {
-    world.killEntity(e);
+    world.destroyEntity(e);
 }
 
 bool EntityManager::isEntityAlive(Entity e) const
 {
-    const auto index = e.getIndex();
-    assert(index < versions.size());
-    return versions[index] == e.getVersion();
+    return ids.isAlive(e.getIndex(), e.getVersion());
 }
 
-Entity EntityManager::getEntity(Entity::Id index)
+Entity EntityManager::getEntity(Entity::Index index)
 {
-    assert(index < versions.size());
-    Entity e(index, versions[index]);
-    e.entityManager = this;
-    return e;
+    return Entity(index, ids.getVersion(index));
 }
 
 const ComponentMask& EntityManager::getComponentMask(Entity e) const
 {
+    // entities that never had components might not be covered by the masks yet
+    static const ComponentMask noComponents;
+
     const auto index = e.getIndex();
-    assert(index < componentMasks.size());
-    return componentMasks[index];
+    return index < componentMasks.size() ? componentMasks[index] : noComponents;
 }
 
-void EntityManager::tagEntity(Entity e, std::string tag)
+void EntityManager::clearChangedEntities()
 {
-    taggedEntities.emplace(tag, e);
-    entityTags.emplace(e.id, v);
+    for (const auto &changedEntity : changedEntities) {
+        changedPositions.remove(changedEntity.entity.getIndex());
+    }
+    changedEntities.clear();
 }
 
-bool EntityManager::hasTag(std::string tag) const
+void EntityManager::markChanged(Entity e, BaseComponent::Id componentId)
 {
-    return taggedEntities.find(tag) != taggedEntities.end();
+    const auto index = e.getIndex();
+    auto position = changedPositions.get(index);
+
+    if (position == SparseIndex::Invalid) {
+        position = changedEntities.size();
+        changedPositions.set(index, position);
+        changedEntities.push_back({ e, ComponentMask() });
+    }
+
+    changedEntities[position].changedComponents.set(componentId);
 }
 
-bool EntityManager::hasTaggedEntity(std::string tag, Entity e) const
+void EntityManager::compact()
 {
-    auto it = taggedEntities.find(tag);
-    if (it != taggedEntities.end()) {
-        if (it->second == e) {
-            return true;
+    for (auto &componentPool : componentPools) {
+        if (componentPool) {
+            componentPool->compact();
+        }
+    }
+
+    // no entity is located in an empty archetype, so they can go (views and eachChunk look archetypes up every time)
+    for (auto it = archetypes.begin(); it != archetypes.end();) {
+        if (it->second->getSize() == 0) {
+            it = archetypes.erase(it);
         }
+        else {
+            it->second->compact();
+            ++it;
+        }
+    }
+
+    const auto size = std::min<std::size_t>(ids.getUsedSize(), componentMasks.size());
+    componentMasks.resize(size);
+    componentMasks.shrink_to_fit();
+    versions.resize(size);
+    versions.shrink_to_fit();
+    if (storageMode == StorageMode::Archetype) {
+        entityLocations.resize(size);
+        entityLocations.shrink_to_fit();
+    }
+
+    changedEntities.shrink_to_fit();
+    changedPositions.compact();
+
+    for (auto &group : groups) {
+        group.second->entities.shrink_to_fit();
+        group.second->positions.compact();
     }
-    return false;
 }
 
-Entity EntityManager::getEntityByTag(std::string tag)
+void EntityManager::accommodateEntity(Entity::Index index)
+{
+    if (index < componentMasks.size()) {
+        return;
+    }
+
+    // cover every index handed out so far, so the vectors grow once for entities created in bulk
+    // (indices past the vectors might have been released by compact, so their versions are copied rather than assumed to be 0)
+    const auto previousSize = versions.size();
+    const auto size = std::max<std::size_t>(ids.getSize(), index + 1);
+    componentMasks.resize(size);
+    versions.resize(size);
+    for (auto i = previousSize; i < size; ++i) {
+        versions[i] = ids.getVersion(Entity::Index(i));
+    }
+    if (storageMode == StorageMode::Archetype) {
+        entityLocations.resize(size);
+    }
+}
+
+EntityManager::EntityLocation EntityManager::addEntityRow(Entity::Index index, const ComponentMask &mask)
+{
+    assert(storageMode == StorageMode::Archetype);
+
+    EntityLocation destination;
+    if (mask.any()) {
+        destination.archetype = &getArchetype(mask);
+        destination.row = destination.archetype->addRow(index);
+    }
+
+    return destination;
+}
+
+void EntityManager::moveEntity(Entity::Index index, const EntityLocation &destination, const ComponentMask &mask)
+{
+    assert(index < entityLocations.size());
+    auto &location = entityLocations[index];
+
+    if (location.archetype) {
+        if (destination.archetype) {
+            location.archetype->moveRow(location.row, *destination.archetype, destination.row);
+        }
+        removeEntityRow(*location.archetype, location.row);
+    }
+
+    location = destination;
+    componentMasks[index] = mask;
+}
+
+void EntityManager::removeEntityRow(Archetype &archetype, unsigned int row)
+{
+    archetype.removeRow(row);
+
+    // the last row was moved into the removed one, so its entity has to be told where it is now
+    if (row < archetype.getSize()) {
+        entityLocations[archetype.getIndex(row)].row = row;
+    }
+}
+
+Archetype& EntityManager::getArchetype(const ComponentMask &mask)
+{
+    auto it = archetypes.find(mask);
+    if (it == archetypes.end()) {
+        std::unique_ptr<Archetype> archetype(new Archetype(mask, resource));
+        it = archetypes.emplace(mask, std::move(archetype)).first;
+    }
+
+    return *it->second;
+}
+
+void EntityManager::tagEntity(Entity e, Symbol tag)
+{
+    // the tag stays with the entity that has it already
+    if (!taggedEntities.emplace(tag, e).second) {
+        return;
+    }
+
+    // an entity has one tag, a new one replaces the old one
+    auto &entityTag = entityTags[e.getIndex()];
+    if (entityTag != Symbol()) {
+        taggedEntities.erase(entityTag);
+    }
+    entityTag = tag;
+}
+
+bool EntityManager::hasTag(Symbol tag) const
+{
+    return taggedEntities.find(tag) != taggedEntities.end();
+}
+
+bool EntityManager::hasTaggedEntity(Symbol tag, Entity e) const
+{
+    auto it = taggedEntities.find(tag);
+    return it != taggedEntities.end() && it->second == e;
+}
+
+Entity EntityManager::getEntityByTag(Symbol tag) const
 {
     assert(hasTag(tag));
-    return taggedEntities[tag];
+    return taggedEntities.find(tag)->second;
 }
 
 int EntityManager::getTagCount() const
@@ -165,48 +588,80 @@ int EntityManager::getTagCount() const
     return taggedEntities.size();
 }
 
-void EntityManager::groupEntity(Entity e, std::string group)
+void EntityManager::groupEntity(Entity e, Symbol group)
+{
+    auto &entry = groups[group];
+    if (!entry) {
+        entry.reset(new Group(resource));
+    }
+
+    if (entry->positions.contains(e.getIndex())) {
+        return;
+    }
+
+    entry->positions.set(e.getIndex(), entry->entities.size());
+    entry->entities.push_back(e);
+    entityGroups[e.getIndex()].push_back(group);
+}
+
+void EntityManager::ungroupEntity(Entity e, Symbol group)
+{
+    if (!hasEntityInGroup(group, e)) {
+        return;
+    }
+
+    removeFromGroup(*groups.find(group)->second, e);
+
+    auto groupedEntity = entityGroups.find(e.getIndex());
+    auto &entityGroupList = groupedEntity->second;
+    entityGroupList.erase(std::find(entityGroupList.begin(), entityGroupList.end(), group));
+    if (entityGroupList.empty()) {
+        entityGroups.erase(groupedEntity);
+    }
+}
+
+void EntityManager::removeFromGroup(Group &group, Entity e)
 {
-    groupedEntities.emplace(group, std::set<Entity>());
-    groupedEntities[group].emplace(e);
-    entityGroups.emplace(e.id, group);
+    const auto position = group.positions.get(e.getIndex());
+    const auto last = group.entities.back();
+
+    group.entities[position] = last;
+    group.positions.set(last.getIndex(), position);
+    group.entities.pop_back();
+    group.positions.remove(e.getIndex());
 }
 
-bool EntityManager::hasGroup(std::string group) const
+bool EntityManager::hasGroup(Symbol group) const
 {
-    return groupedEntities.find(group) != groupedEntities.end();
+    return groups.find(group) != groups.end();
 }
 
-bool EntityManager::hasEntityInGroup(std::string group, Entity e) const
+bool EntityManager::hasEntityInGroup(Symbol group, Entity e) const
 {
-    auto it = groupedEntities.find(group);
-    if (it != groupedEntities.end()) {
-        if (it->second.find(e.id) != it->second.end()) {
-            return true;
-        }
+    auto it = groups.find(group);
+    if (it == groups.end()) {
+        return false;
     }
-    return false;
+
+    const auto position = it->second->positions.get(e.getIndex());
+    return position != SparseIndex::Invalid && it->second->entities[position] == e;
 }
 
-std::vector<Entity> EntityManager::getEntityGroup(std::string group)
+const std::pmr::vector<Entity>& EntityManager::getEntityGroup(Symbol group) const
 {
     assert(hasGroup(group));
-    auto &s = groupedEntities[group];
-    return std::vector<Entity>(s.begin(), s.end());
+    return groups.find(group)->second->entities;
 }
 
 int EntityManager::getGroupCount() const
 {
-    return groupedEntities.size();
+    return groups.size();
 }
 
-int EntityManager::getEntityGroupCount(std::string group)
+int EntityManager::getEntityGroupCount(Symbol group) const
 {
-    if (!hasGroup(group)) {
-        return 0;
-    }
-
-    return groupedEntities[group].size();
+    auto it = groups.find(group);
+    return it != groups.end() ? it->second->entities.size() : 0;
 }
 
 }
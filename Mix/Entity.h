@@ -3,12 +3,17 @@
 #include "Config.h"
 #include "Component.h"
 #include "Pool.h"
+#include "Archetype.h"
+#include "Symbol.h"
 #include <vector>
 #include <deque>
 #include <unordered_map>
-#include <set>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <functional>
+#include <atomic>
+#include <type_traits>
 #include <cstdint>
 
 namespace Mix
@@ -16,38 +21,95 @@ namespace Mix
 
 class World;
 class EntityManager;
+class Prefab;
+template <typename ... T> class View;
+
+/*
+    How an entity manager stores component data.
+    Sparse: one sparse set pool per component type, good for adding/removing components often.
+    Archetype: entities with the same component mask are stored together in chunks with one column per component type,
+    good for iterating many entities with the same components (see EntityManager::eachChunk).
+*/
+enum class StorageMode
+{
+    Sparse,
+    Archetype
+};
 
-// Basically just an id.
+// Basically just an id (index + version), see EntityRef for an entity with convenience methods.
 class Entity
 {
 public:
-    using Id = uint32_t;
-    using Version = uint8_t;
+    static const unsigned int IndexBits = INDEX_BITS;
+    static const unsigned int VersionBits = VERSION_BITS;
+
+    // the smallest unsigned types that fit, e.g. 24/8 bits makes a 32-bit id and 32/32 bits a 64-bit id
+    using Id = std::conditional_t<(IndexBits + VersionBits > 32), std::uint64_t, std::uint32_t>;
+    using Index = std::uint32_t;
+    using Version = std::conditional_t<(VersionBits <= 8), std::uint8_t, std::conditional_t<(VersionBits <= 16), std::uint16_t, std::uint32_t>>;
 
     /*
         Id = index + version (kinda).
     */
-    Entity(Id index = 0, Version version = 0) { id = (version << IndexBits) | index; }
+    Entity(Index index = 0, Version version = 0) : id((Id(version) << IndexBits) | index) {}
 
     Entity(const Entity&) = default;
     Entity& operator=(const Entity&) = default;
 
     /*
-        Comparison operators.
+        Comparison operators, they compare the whole id so a stale entity never equals the entity that reuses its index.
     */
-    bool operator==(const Entity &e) const { return getIndex() == e.getIndex(); }
-    bool operator!=(const Entity &e) const { return getIndex() != e.getIndex(); }
-    bool operator<(const Entity &e) const { return getIndex() < e.getIndex(); }
+    bool operator==(const Entity &e) const { return id == e.id; }
+    bool operator!=(const Entity &e) const { return id != e.id; }
+    bool operator<(const Entity &e) const { return id < e.id; }
+
+    /*
+        Returns the whole id.
+    */
+    Id getId() const { return id; }
 
     /*
         Returns the index part of the id.
     */
-    Id getIndex() const { return id & IndexMask; }
+    Index getIndex() const { return Index(id & IndexMask); }
 
     /*
         Returns the version part of the id.
     */
-    Version getVersion() const { return (id >> IndexBits) & VersionMask; }
+    Version getVersion() const { return Version((id >> IndexBits) & VersionMask); }
+
+    /*
+        Returns a string of the entity (id + version).
+    */
+    std::string toString() const;
+
+private:
+    static_assert(IndexBits > 0 && IndexBits <= 32, "entity indices are at most 32 bits");
+    static_assert(VersionBits > 0 && VersionBits <= 32, "entity versions are at most 32 bits");
+
+    static const Id IndexMask = (Id(1) << IndexBits) - 1;
+    static const Id VersionMask = (Id(1) << VersionBits) - 1;
+
+    // Id = index + version (kinda).
+    Id id;
+
+    friend class EntityIdAllocator;
+};
+
+/*
+    An entity along with the entity manager it belongs to, so that it can be used on its own, e.g.
+    world.createEntity().addComponent<PositionComponent>(0, 0). Converts to Entity, which is what should be stored.
+*/
+class EntityRef
+{
+public:
+    EntityRef(Entity entity, EntityManager &entityManager) : entity(entity), entityManager(&entityManager) {}
+
+    operator Entity() const { return entity; }
+    Entity getEntity() const { return entity; }
+
+    Entity::Index getIndex() const { return entity.getIndex(); }
+    Entity::Version getVersion() const { return entity.getVersion(); }
 
     /*
         Kills the entity (destroyed when the world updates).
@@ -67,52 +129,149 @@ public:
     template <typename T> void removeComponent();
     template <typename T> bool hasComponent() const;
     template <typename T> T& getComponent() const;
+    template <typename T> T* tryGetComponent() const;
 
     /*
         Tags the entity.
     */
-    void tag(std::string tag);
-    bool hasTag(std::string tag) const;
+    void tag(Symbol tag);
+    bool hasTag(Symbol tag) const;
 
     /*
-        Adds the entity to a certain group.
+        Adds the entity to a certain group (an entity can be in any number of groups).
     */
-    void group(std::string group);
-    bool hasGroup(std::string group) const;
+    void group(Symbol group);
+    void ungroup(Symbol group);
+    bool hasGroup(Symbol group) const;
+
+    std::string toString() const { return entity.toString(); }
+
+private:
+    Entity entity;
+    EntityManager *entityManager;
+};
+
+/*
+    Hands out entity indices and keeps track of their versions.
+    Allocating indices and checking versions is safe from any number of threads at once (version checks are wait-free),
+    freeing indices must happen on one thread at a time.
+
+    Versions live in pages that are allocated as indices are handed out, so they never move once published.
+    Freed indices wait in a FIFO queue and are reused once more than MINIMUM_FREE_IDS are waiting, threads claim them with a compare-and-swap.
+    Until then fresh indices are taken from an atomic counter.
+*/
+class EntityIdAllocator
+{
+public:
+    EntityIdAllocator();
+    ~EntityIdAllocator();
+
+    EntityIdAllocator(const EntityIdAllocator&) = delete;
+    EntityIdAllocator& operator=(const EntityIdAllocator&) = delete;
+
+    // returns a reused index if enough are free, otherwise a fresh one
+    Entity::Index allocate();
+
+    // claims a freed index, returns false if no more than the minimum amount of indices are free
+    bool reuse(Entity::Index &index);
+
+    // returns the first of count fresh (consecutive, never used) indices
+    Entity::Index allocateFresh(unsigned int count = 1);
+
+    // increments the version of the index and queues it for reuse (one thread at a time)
+    void free(Entity::Index index);
 
     /*
-        Returns a string of the entity (id + version).
+        Returns the highest index in use + 1, i.e. every index from there up to getSize is free. The free indices stay queued
+        (they're only reused after MINIMUM_FREE_IDS others, so stale entities don't alias new ones), this only tells how much
+        per-entity data is needed. Must not be called while indices are allocated or freed.
     */
-    std::string toString() const;
+    std::uint64_t getUsedSize() const;
+
+    bool isAlive(Entity::Index index, Entity::Version version) const;
+
+    // returns 0 for indices that haven't been handed out yet (even if they're below getSize, see allocateFresh)
+    Entity::Version getVersion(Entity::Index index) const;
+
+    // returns the number of indices handed out so far (every index ever used is below it)
+    std::uint64_t getSize() const { return size.load(std::memory_order_acquire); }
 
 private:
-    EntityManager& getEntityManager() const;
+    static const std::uint64_t IndexCount = std::uint64_t(1) << Entity::IndexBits;
+    static const unsigned int PageSize = ENTITY_PAGE_SIZE;
+    static const std::uint64_t PageCount = (IndexCount + PageSize - 1) / PageSize;
+    static const unsigned int PagesPerDirectory = 1024;
+    static const unsigned int DirectoryCount = (PageCount + PagesPerDirectory - 1) / PagesPerDirectory;
+    static const unsigned int QueueSize = FREE_ID_QUEUE_SIZE;
 
-    static const uint32_t IndexBits = INDEX_BITS;
-    static const uint32_t IndexMask = (1 << IndexBits) - 1;
-    static const uint32_t VersionBits = VERSION_BITS;
-    static const uint32_t VersionMask = (1 << VersionBits) - 1;
+    using Version = std::atomic<Entity::Version>;
+    using Directory = std::atomic<Version*>;
 
-    // Id = index + version (kinda).
-    Id id;
+    // returns the version of the index (null if its page hasn't been allocated)
+    Version* findVersion(Entity::Index index) const;
+
+    // allocates the version pages of the indices [first, last) that don't exist yet
+    void accommodateVersions(std::uint64_t first, std::uint64_t last);
+
+    // moves indices that didn't fit in the queue into it (freeing thread only)
+    void drainOverflow();
+
+    /*
+        Versions are paged in two levels, so that the fixed top level stays small even with 32-bit indices:
+        directory = index / (page size * pages per directory), page within the directory = index / page size % pages per directory.
+        Directories and pages are both allocated on demand and published with a compare-and-swap.
+    */
+    std::unique_ptr<std::atomic<Directory*>[]> directories;
+    std::atomic<std::uint64_t> size{0};
 
-    EntityManager *entityManager = nullptr;
-    friend class EntityManager;
+    // ring buffer of free indices, positions only grow (slot = position % queue size)
+    std::unique_ptr<std::atomic<Entity::Index>[]> freeQueue;
+    std::atomic<std::uint64_t> freeHead{0};
+    std::atomic<std::uint64_t> freeTail{0};
+
+    // freed indices that didn't fit in the queue (freeing thread only)
+    std::deque<Entity::Index> overflow;
 };
 
 class EntityManager
 {
 public:
-    EntityManager(World &world) : world(world) {}
+    // component storage, per-entity data and groups are allocated from the memory resource
+    EntityManager(World &world, StorageMode storageMode = StorageMode::Sparse, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
     /*
         Entity management.
+        createEntity, createEntities (without prototype), isEntityAlive and getEntity are safe to call from any thread,
+        everything else must be called from one thread at a time (the one that updates the world).
     */
     Entity createEntity();
     void destroyEntity(Entity e);
     void killEntity(Entity e);
+
+    /*
+        Batch entity management, fresh indices are reserved in one go for all the entities.
+        createEntities appends the created entities to the vector, when given a prototype entity
+        each created entity gets a copy of each of the prototype's components.
+    */
+    void createEntities(unsigned int count, std::vector<Entity> &entities);
+    void createEntities(unsigned int count, Entity prototype, std::vector<Entity> &entities);
+    void destroyEntities(const Entity *first, const Entity *last);
+
+    // creates count entities with the prefab's components and appends them to the vector
+    void instantiate(const Prefab &prefab, unsigned int count, std::vector<Entity> &entities);
+
     bool isEntityAlive(Entity e) const;
-    Entity getEntity(Entity::Id index);
+    Entity getEntity(Entity::Index index);
+
+    /*
+        Releases the memory that isn't needed for the entities and components currently alive: shrinks the component pools,
+        frees unused sparse pages and empty archetypes, and releases the per-entity data after the highest entity index in use.
+        Meant to be called once in a while (e.g. after a mass despawn), not from other threads while entities are created.
+    */
+    void compact();
+
+    // returns the entity along with this entity manager (see EntityRef)
+    EntityRef getEntityRef(Entity e) { return EntityRef(e, *this); }
 
     /*
         Component management.
@@ -122,117 +281,239 @@ public:
     template <typename T> void removeComponent(Entity e);
     template <typename T> bool hasComponent(Entity e) const;
     template <typename T> T& getComponent(Entity e) const;
+
+    // returns null if the entity isn't alive anymore (or doesn't have the component), instead of asserting
+    template <typename T> T* tryGetComponent(Entity e) const;
     const ComponentMask& getComponentMask(Entity e) const;
+    StorageMode getStorageMode() const { return storageMode; }
+
+    /*
+        Calls f(count, T* ...) for each chunk of the archetypes that have all components T, where count is the number of
+        entities in the chunk and each T* points to the chunk's column of that component type (archetype storage only).
+        A const T gets a const T* column, e.g. eachChunk<Position, const Velocity>.
+    */
+    template <typename ... T, typename F> void eachChunk(F &&f);
+
+    /*
+        Returns a view of all entities that have the components T (see View.h), e.g. view<Position, const Velocity>().
+    */
+    template <typename ... T> View<T...> view();
+
+    /*
+        Entities whose component mask changed (a component was added or removed) since the changes were last cleared,
+        along with the components that changed. World::update uses this to update the systems' entity lists.
+    */
+    struct ChangedEntity
+    {
+        Entity entity;
+        ComponentMask changedComponents;
+    };
+    const std::pmr::vector<ChangedEntity>& getChangedEntities() const { return changedEntities; }
+    void clearChangedEntities();
 
     /*
-        Tag management.
+        Tag management (a tag names one entity, and an entity has one tag: tagging it again replaces its tag).
     */
-    void tagEntity(Entity e, std::string tag);
-    bool hasTag(std::string tag) const;
-    bool hasTaggedEntity(std::string tag, Entity e) const;
-    Entity getEntityByTag(std::string tag);
+    void tagEntity(Entity e, Symbol tag);
+    bool hasTag(Symbol tag) const;
+    bool hasTaggedEntity(Symbol tag, Entity e) const;
+    Entity getEntityByTag(Symbol tag) const;
     int getTagCount() const;
 
     /*
-        Group management.
+        Group management. Groups are kept as packed entity arrays (removing an entity moves the group's last entity into its place),
+        getEntityGroup returns the array itself, which is only valid until the group changes. A group exists once an entity was added to it.
     */
-    void groupEntity(Entity e, std::string group);
-    bool hasGroup(std::string group) const;
-    bool hasEntityInGroup(std::string group, Entity e) const;
-    std::vector<Entity> getEntityGroup(std::string group);
+    void groupEntity(Entity e, Symbol group);
+    void ungroupEntity(Entity e, Symbol group);
+    bool hasGroup(Symbol group) const;
+    bool hasEntityInGroup(Symbol group, Entity e) const;
+    const std::pmr::vector<Entity>& getEntityGroup(Symbol group) const;
     int getGroupCount() const;
-    int getEntityGroupCount(std::string group);
+    int getEntityGroupCount(Symbol group) const;
 
 private:
     template <typename T>
-    std::shared_ptr<Pool<T>> accommodateComponent();
+    SparsePool<T>* accommodateComponent();
+
+    // copies the components of the prototype to each of the entities (which must not have any components yet)
+    void copyComponents(Entity prototype, const Entity *first, const Entity *last);
+
+    // records that a component was added to or removed from the entity
+    void markChanged(Entity e, BaseComponent::Id componentId);
 
-    // minimum amount of free indices before we reuse one
-    const std::uint32_t MinimumFreeIds = MINIMUM_FREE_IDS;
+    /*
+        Grows the component masks (and entity locations) to cover the entity index. Entities can be created from any thread,
+        so the per-entity vectors are only grown once components are added (on the thread that manages components).
+    */
+    void accommodateEntity(Entity::Index index);
+
+    // where an entity's components are stored (archetype storage)
+    struct EntityLocation
+    {
+        Archetype *archetype = nullptr;
+        unsigned int row = 0;
+    };
+
+    /*
+        Archetype storage: changing an entity's mask is done in two steps, first a row is added to the archetype of the new mask
+        (no row if the mask is empty), then the entity's components are moved to that row (components not in the new mask are destroyed).
+        In between, components that are new to the entity can be constructed in the new row.
+    */
+    EntityLocation addEntityRow(Entity::Index index, const ComponentMask &mask);
+    void moveEntity(Entity::Index index, const EntityLocation &destination, const ComponentMask &mask);
+    void removeEntityRow(Archetype &archetype, unsigned int row);
+    Archetype& getArchetype(const ComponentMask &mask);
 
-    // deque of free entity indices
-    std::deque<Entity::Id> freeIds;
+    StorageMode storageMode;
 
-    // vector of versions (index = entity index)
-    std::vector<Entity::Version> versions;
+    // entity indices and their versions
+    EntityIdAllocator ids;
 
     // vector of component pools, each pool contains all the data for a certain component type
-    // vector index = component id, pool index = entity id
-    std::vector<std::shared_ptr<BasePool>> componentPools;
+    // vector index = component id, pool is a sparse set keyed by entity index
+    std::vector<std::unique_ptr<AbstractComponentPool>> componentPools;
 
     // vector of component masks, each mask lets us know which components are turned "on" for a specific entity
     // vector index = entity id, each bit set to 1 means that the entity has that component
-    std::vector<ComponentMask> componentMasks;
+    std::pmr::vector<ComponentMask> componentMasks;
+
+    // vector index = entity id, the current version of each index (a copy of the id allocator's, cheap to check on the component thread)
+    std::pmr::vector<Entity::Version> versions;
+
+    // entities whose component mask changed, and entity index -> position in changedEntities
+    std::pmr::vector<ChangedEntity> changedEntities;
+    SparseIndex changedPositions;
+
+    // archetype storage: one archetype per distinct component mask
+    std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> archetypes;
+
+    // archetype storage: vector index = entity id, where the entity's row is (archetype is null if the entity has no components)
+    std::pmr::vector<EntityLocation> entityLocations;
+
+    // the entities of a group, and entity index -> position in entities
+    struct Group
+    {
+        Group(std::pmr::memory_resource *resource) : entities(resource), positions(resource) {}
+
+        std::pmr::vector<Entity> entities;
+        SparseIndex positions;
+    };
+
+    // removes the entity from the group (the group's last entity takes its place)
+    void removeFromGroup(Group &group, Entity e);
+
+    // maps a tag to an entity, and an entity index to its tag
+    std::pmr::unordered_map<Symbol, Entity> taggedEntities;
+    std::pmr::unordered_map<Entity::Index, Symbol> entityTags;
 
-    // maps a tag to an entity
-    std::unordered_map<std::string, Entity> taggedEntities;
-    std::unordered_map<Entity::Id, std::string> entityTags;
+    // maps a group name to the group, and an entity index to the groups it's in
+    std::pmr::unordered_map<Symbol, std::unique_ptr<Group>> groups;
+    std::pmr::unordered_map<Entity::Index, std::pmr::vector<Symbol>> entityGroups;
 
-    // maps a tag to a group of entities
-    std::unordered_map<std::string, std::set<Entity>> groupedEntities;
-    std::unordered_map<Entity::Id, std::string> entityGroups;
+    std::pmr::memory_resource *resource;
 
     World &world;
+    template <typename ...> friend class View;
+    friend class Prefab;
 };
 
 template <typename T>
-void Entity::addComponent(T component)
+void EntityRef::addComponent(T component)
 {
-    getEntityManager().addComponent<T>(*this, component);
+    entityManager->addComponent<T, T>(entity, std::move(component));
 }
 
 template <typename T, typename ... Args>
-void Entity::addComponent(Args && ... args)
+void EntityRef::addComponent(Args && ... args)
 {
-    getEntityManager().addComponent<T>(*this, std::forward<Args>(args)...);
+    entityManager->addComponent<T>(entity, std::forward<Args>(args)...);
 }
 
 template <typename T>
-void Entity::removeComponent()
+void EntityRef::removeComponent()
 {
-    getEntityManager().removeComponent<T>(*this);
+    entityManager->removeComponent<T>(entity);
 }
 
 template <typename T>
-bool Entity::hasComponent() const
+bool EntityRef::hasComponent() const
 {
-    return getEntityManager().hasComponent<T>(*this);
+    return entityManager->hasComponent<T>(entity);
 }
 
 template <typename T>
-T& Entity::getComponent() const
+T& EntityRef::getComponent() const
 {
-    return getEntityManager().getComponent<T>(*this);
+    return entityManager->getComponent<T>(entity);
+}
+
+template <typename T>
+T* EntityRef::tryGetComponent() const
+{
+    return entityManager->tryGetComponent<T>(entity);
 }
 
 template <typename T>
 void EntityManager::addComponent(Entity e, T component)
+{
+    addComponent<T, T>(e, std::move(component));
+}
+
+template <typename T, typename ... Args>
+void EntityManager::addComponent(Entity e, Args && ... args)
 {
     const auto componentId = Component<T>::getId();
     const auto entityId = e.getIndex();
-    std::shared_ptr<Pool<T>> componentPool = accommodateComponent<T>();
+    accommodateEntity(entityId);
+
+    if (storageMode == StorageMode::Archetype) {
+        if (componentMasks[entityId].test(componentId)) {
+            getComponent<T>(e) = T(std::forward<Args>(args) ...);
+            return;
+        }
+
+        auto mask = componentMasks[entityId];
+        mask.set(componentId);
+
+        // construct the component in its new row before the entity's other components move there (args might refer to them)
+        const auto destination = addEntityRow(entityId, mask);
+        new (destination.archetype->getComponent(destination.row, componentId)) T(std::forward<Args>(args) ...);
+        moveEntity(entityId, destination, mask);
+        markChanged(e, componentId);
+        return;
+    }
+
+    auto *componentPool = accommodateComponent<T>();
 
-    if (entityId >= componentPool->getSize()) {
-        componentPool->resize(versions.size());
+    if (!componentMasks[entityId].test(componentId)) {
+        markChanged(e, componentId);
     }
 
-    componentPool->set(entityId, component);
+    componentPool->emplace(entityId, std::forward<Args>(args) ...);
     componentMasks[entityId].set(componentId);
 }
 
-template <typename T, typename ... Args>
-void EntityManager::addComponent(Entity e, Args && ... args)
-{
-    T component(std::forward<Args>(args) ...);
-    addComponent<T>(e, component);
-}
-
 template <typename T>
 void EntityManager::removeComponent(Entity e)
 {
     const auto componentId = Component<T>::getId();
     const auto entityId = e.getIndex();
-    assert(entityId < componentMasks.size());
+
+    if (entityId >= componentMasks.size() || !componentMasks[entityId].test(componentId)) {
+        return;
+    }
+
+    markChanged(e, componentId);
+
+    if (storageMode == StorageMode::Archetype) {
+        auto mask = componentMasks[entityId];
+        mask.set(componentId, false);
+        moveEntity(entityId, addEntityRow(entityId, mask), mask);
+        return;
+    }
+
+    componentPools[componentId]->remove(entityId);
     componentMasks[entityId].set(componentId, false);
 }
 
@@ -241,8 +522,7 @@ bool EntityManager::hasComponent(Entity e) const
 {
     const auto componentId = Component<T>::getId();
     const auto entityId = e.getIndex();
-    assert(entityId < componentMasks.size());
-    return componentMasks[entityId].test(componentId);
+    return entityId < componentMasks.size() && componentMasks[entityId].test(componentId);
 }
 
 template <typename T>
@@ -252,29 +532,85 @@ T& EntityManager::getComponent(Entity e) const
     const auto entityId = e.getIndex();
 
     assert(hasComponent<T>(e));
+
+    if (storageMode == StorageMode::Archetype) {
+        const auto &location = entityLocations[entityId];
+        return location.archetype->get<T>(location.row);
+    }
+
     assert(componentId < componentPools.size());
-    auto componentPool = std::static_pointer_cast<Pool<T>>(componentPools[componentId]);
+    auto *componentPool = static_cast<SparsePool<T>*>(componentPools[componentId].get());
 
     assert(componentPool);
-    assert(entityId < componentPool->getSize());
     return componentPool->get(entityId);
 }
 
 template <typename T>
-std::shared_ptr<Pool<T>> EntityManager::accommodateComponent()
+T* EntityManager::tryGetComponent(Entity e) const
+{
+    const auto componentId = Component<T>::getId();
+    const auto entityId = e.getIndex();
+
+    if (entityId >= componentMasks.size() || versions[entityId] != e.getVersion() || !componentMasks[entityId].test(componentId)) {
+        return nullptr;
+    }
+
+    if (storageMode == StorageMode::Archetype) {
+        const auto &location = entityLocations[entityId];
+        return &location.archetype->get<T>(location.row);
+    }
+
+    return &static_cast<SparsePool<T>*>(componentPools[componentId].get())->get(entityId);
+}
+
+template <typename T>
+SparsePool<T>* EntityManager::accommodateComponent()
 {
     const auto componentId = Component<T>::getId();
 
     if (componentId >= componentPools.size()) {
-        componentPools.resize(componentId + 1, nullptr);
+        componentPools.resize(componentId + 1);
     }
 
     if (!componentPools[componentId]) {
-        std::shared_ptr<Pool<T>> pool(new Pool<T>());
-        componentPools[componentId] = pool;
+        componentPools[componentId].reset(new SparsePool<T>(resource));
     }
 
-    return std::static_pointer_cast<Pool<T>>(componentPools[componentId]);
+    return static_cast<SparsePool<T>*>(componentPools[componentId].get());
+}
+
+template <typename ... T, typename F>
+void EntityManager::eachChunk(F &&f)
+{
+    assert(storageMode == StorageMode::Archetype);
+
+    ComponentMask mask;
+    (mask.set(Component<std::remove_const_t<T>>::getId()), ...);
+
+    for (auto &it : archetypes) {
+        auto &archetype = *it.second;
+        if (!archetype.getMask().includes(mask)) {
+            continue;
+        }
+
+        for (unsigned int chunk = 0; chunk < archetype.getChunkCount(); ++chunk) {
+            f(archetype.getChunkSize(chunk), static_cast<T*>(archetype.template getColumn<std::remove_const_t<T>>(chunk)) ...);
+        }
+    }
 }
 
 }
+
+namespace std
+{
+
+template <>
+struct hash<Mix::Entity>
+{
+    std::size_t operator()(const Mix::Entity &e) const
+    {
+        return std::hash<Mix::Entity::Id>()(e.getId());
+    }
+};
+
+}
@@ -1,17 +1,181 @@
 #include "Event.h"
 #include "World.h"
+#include <initializer_list>
 
 namespace Mix
 {
 
-BaseEvent::Id BaseEvent::nextId = 0;
+namespace
+{
+
+// the emit key of the thread: source (e.g. system) in the upper half, batch in the lower half
+thread_local std::uint64_t emitKey = 0;
+
+}
+
+TypeRegistry& BaseEvent::getRegistry()
+{
+    static TypeRegistry registry(MaxEvents, RESERVED_EVENT_IDS);
+    return registry;
+}
+
+const TypeInfo* BaseEvent::getInfo(Id id)
+{
+    return getRegistry().get(id);
+}
 
-void EventManager::destroyEvents()
+BaseEvent::Id BaseEvent::findId(const char *name)
 {
-    for (auto &it : eventPools) {
-        auto pool = it.second;
-        pool->clear();
+    const auto id = getRegistry().find(TypeInfo::hash(name));
+    return id == TypeRegistry::NoId ? MaxEvents : Id(id);
+}
+
+EventManager::EventManager(World &world, std::pmr::memory_resource *resource)
+    : channels(new std::atomic<BaseEventChannel*>[BaseEvent::MaxEvents]), resource(resource), world(world)
+{
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        channels[i].store(nullptr, std::memory_order_relaxed);
     }
 }
 
+EventManager::~EventManager()
+{
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        delete channels[i].load(std::memory_order_relaxed);
+    }
+}
+
+void EventManager::swapEvents()
+{
+    assert(!concurrent);
+    emittedCount.store(0, std::memory_order_relaxed);
+
+    // the events and commands recorded with the old batch numbers have been merged and played back
+    nextBatch.store(1, std::memory_order_relaxed);
+
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        if (auto *channel = channels[i].load(std::memory_order_relaxed)) {
+            channel->swap();
+        }
+    }
+}
+
+void EventManager::compact()
+{
+    assert(!concurrent);
+
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        if (auto *channel = channels[i].load(std::memory_order_relaxed)) {
+            channel->compact();
+        }
+    }
+}
+
+EventManager::BaseEventChannel::~BaseEventChannel()
+{
+    for (auto *handlers : { &immediateHandlers, &deferredHandlers }) {
+        for (const auto &handler : *handlers) {
+            if (handler.destroy) {
+                handler.destroy(handler.object);
+            }
+        }
+    }
+}
+
+bool EventManager::BaseEventChannel::unsubscribe(SubscriptionId id)
+{
+    for (auto *handlers : { &immediateHandlers, &deferredHandlers }) {
+        for (auto it = handlers->begin(); it != handlers->end(); ++it) {
+            if (it->id == id) {
+                if (it->destroy) {
+                    it->destroy(it->object);
+                }
+                handlers->erase(it);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void EventManager::unsubscribe(SubscriptionId id)
+{
+    assert(!concurrent);
+
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        auto *channel = channels[i].load(std::memory_order_relaxed);
+        if (channel && channel->unsubscribe(id)) {
+            return;
+        }
+    }
+}
+
+void EventManager::dispatchEvents()
+{
+    assert(!concurrent);
+
+    // handlers might emit events into channels that were dispatched earlier in the pass, so pass until nothing is left
+    for (bool any = true; any;) {
+        any = false;
+        for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+            if (auto *channel = channels[i].load(std::memory_order_relaxed)) {
+                any = channel->dispatch() || any;
+            }
+        }
+    }
+}
+
+void EventManager::beginConcurrentPhase(unsigned int threadCount)
+{
+    assert(!concurrent);
+    this->threadCount = std::max(threadCount, 1u);
+
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        if (auto *channel = channels[i].load(std::memory_order_relaxed)) {
+            channel->setThreadCount(this->threadCount);
+        }
+    }
+
+    concurrent = true;
+}
+
+void EventManager::endConcurrentPhase()
+{
+    assert(concurrent);
+    concurrent = false;
+
+    auto &scratch = world.getFrameResource();
+    for (unsigned int i = 0; i < BaseEvent::MaxEvents; ++i) {
+        if (auto *channel = channels[i].load(std::memory_order_acquire)) {
+            channel->merge(scratch);
+        }
+    }
+}
+
+std::uint32_t EventManager::reserveBatches(std::uint32_t count)
+{
+    return nextBatch.fetch_add(count, std::memory_order_relaxed);
+}
+
+EventManager::EmitScope::EmitScope(std::uint32_t source, std::uint32_t batch) : previousKey(emitKey)
+{
+    emitKey = (std::uint64_t(source) << 32) | batch;
+}
+
+EventManager::EmitScope::~EmitScope()
+{
+    emitKey = previousKey;
+}
+
+std::uint32_t EventManager::getEmitSource()
+{
+    return std::uint32_t(emitKey >> 32);
+}
+
+std::uint64_t EventManager::getEmitKey()
+{
+    return emitKey;
+}
+
 }
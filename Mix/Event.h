@@ -1,11 +1,18 @@
 #pragma once
 
+#include "Config.h"
 #include "Pool.h"
-#include <unordered_map>
+#include "ThreadPool.h"
+#include "TypeRegistry.h"
 #include <vector>
 #include <memory>
-#include <typeindex>
+#include <memory_resource>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
 #include <cstdint>
+#include <cassert>
 
 namespace Mix
 {
@@ -14,43 +21,330 @@ class World;
 
 struct BaseEvent
 {
-    using Id = uint8_t;
+    using Id = uint16_t;
+    static const Id MaxEvents = MAX_EVENTS;
+    static_assert(MAX_EVENTS > 0 && MAX_EVENTS <= 65535, "MAX_EVENTS doesn't fit in an event id");
+    static_assert(RESERVED_EVENT_IDS <= MAX_EVENTS, "more reserved event ids than event ids");
+
+    // returns the info of the event type with the id, null if no event type has that id (yet)
+    static const TypeInfo* getInfo(Id id);
+
+    // returns the id of the event type with the name (see EventTraits), MaxEvents if no such type has been used yet
+    static Id findId(const char *name);
+
 protected:
-    static Id nextId;
+    static TypeRegistry& getRegistry();
 };
 
+// The id is fixed if the type's EventTraits give one, otherwise it's assigned on first use (thread-safe).
 template <typename T>
 struct Event : BaseEvent
 {
     // Returns the unique id of Event<T>
     static Id getId()
     {
-        static auto id = nextId++;
+        static const TypeInfo info = TypeInfo::make<T, EventTraits<T>>();
+        static const auto id = Id(getRegistry().add<EventTraits<T>>(info));
         return id;
     }
 };
 
+/*
+    A read-only range over the events of one type, pointing straight into the event storage (no copy).
+    Only valid until the next swapEvents (i.e. the next world update).
+*/
+template <typename T>
+class EventRange
+{
+public:
+    EventRange(const T *first = nullptr, const T *last = nullptr) : first(first), last(last) {}
+
+    const T* begin() const { return first; }
+    const T* end() const { return last; }
+    unsigned int size() const { return last - first; }
+    bool empty() const { return first == last; }
+    const T& operator[](unsigned int index) const { return first[index]; }
+
+private:
+    const T *first;
+    const T *last;
+};
+
+// When a subscribed handler is called: as the event is emitted, or when the events are dispatched (see EventManager::dispatchEvents).
+enum class Dispatch { Immediate, Deferred };
+
+/*
+    Events are double buffered: events emitted during frame N are readable by every system during frame N+1,
+    so the order in which systems are updated doesn't decide whether an event is seen.
+
+    Events can also be handled as they come by subscribing a handler (any callable taking const T&) or a receiver (an object with
+    a receive(const T&) method). Handlers are stored per event type as plain function pointer + object pairs, so calling one costs
+    an indirect call. Immediate handlers of events emitted during a concurrent phase are called on the emitting thread.
+    Subscribing and unsubscribing must not happen during a concurrent phase or from within a handler of the same event type.
+
+    Events can be emitted from many threads at once during a concurrent phase (SystemManager::update and System::parallelEach start one).
+    Each thread then appends to a buffer of its own without locking, and when the phase ends the buffers are merged ordered by
+    emit key, i.e. by the system (and the batch of parallelEach) that emitted them, so the result doesn't depend on thread scheduling.
+    Keys are made unique with reserveBatches, so that two threads never emit with the same key and the thread index never decides the order.
+*/
 class EventManager
 {
 public:
-    EventManager(World &world) : world(world) {}
+    // the event buffers are allocated from the memory resource (which must be thread-safe if events are emitted concurrently)
+    EventManager(World &world, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+    ~EventManager();
+
+    EventManager(const EventManager&) = delete;
+    EventManager& operator=(const EventManager&) = delete;
 
     template <typename T>
     void emitEvent(T event);
-    
+
     template <typename T, typename ... Args>
     void emitEvent(Args && ... args);
 
+    using SubscriptionId = std::uint32_t;
+
+    // calls f(const T&) for each emitted event of type T, returns an id to unsubscribe with
+    template <typename T, typename F>
+    SubscriptionId subscribe(F &&f, Dispatch dispatch = Dispatch::Immediate);
+
+    // calls receiver.receive(const T&) for each emitted event of type T (the receiver must outlive the subscription)
+    template <typename T, typename R>
+    SubscriptionId subscribeReceiver(R &receiver, Dispatch dispatch = Dispatch::Immediate);
+
+    void unsubscribe(SubscriptionId id);
+
+    /*
+        Calls the deferred handlers for the events emitted since the last dispatch (World::update dispatches before swapping),
+        including events emitted by the handlers themselves (into any channel, the channels are passed over until none has
+        undispatched events). A deferred handler that always emits an event it ends up handling again never returns.
+    */
+    void dispatchEvents();
+
+    // returns the events of type T that were emitted before the last swap
     template <typename T>
-    std::vector<T> getEvents();
+    EventRange<T> getEvents() const;
+
+    // destroys the readable events and makes the events emitted since the last swap readable (called by World::update)
+    void swapEvents();
+
+    // returns the number of events emitted since the last swap (only counted when PROFILING is set in Config.h)
+    unsigned int getEmittedCount() const { return emittedCount.load(std::memory_order_relaxed); }
 
-    void destroyEvents();
+    // releases the memory the event buffers keep around between frames
+    void compact();
+
+    /*
+        Starts a concurrent phase for threads with thread index (see ThreadPool::getThreadIndex) below threadCount.
+        Ending it merges the per-thread buffers. Must be called while no events are being emitted.
+    */
+    void beginConcurrentPhase(unsigned int threadCount);
+    void endConcurrentPhase();
+    bool isConcurrentPhase() const { return concurrent; }
+
+    // Sets the emit key of the calling thread for as long as the scope lives (events are merged in ascending key order).
+    class EmitScope
+    {
+    public:
+        EmitScope(std::uint32_t source, std::uint32_t batch = 0);
+        ~EmitScope();
+
+        EmitScope(const EmitScope&) = delete;
+        EmitScope& operator=(const EmitScope&) = delete;
+
+    private:
+        std::uint64_t previousKey;
+    };
+
+    /*
+        Reserves count consecutive batch numbers for emit keys, unique until the next swap. Numbers reserved later are larger,
+        so the keys of one source (which reserves from one thread at a time) sort in the order they were reserved.
+    */
+    std::uint32_t reserveBatches(std::uint32_t count);
+
+    // returns the calling thread's emit key, or just its source part (e.g. the system being updated)
+    static std::uint64_t getEmitKey();
+    static std::uint32_t getEmitSource();
 
 private:
+    // a type-erased handler, invoke casts object and event back to their types
+    struct Handler
+    {
+        void *object;
+        void (*invoke)(void *object, const void *event);
+        void (*destroy)(void *object); // null if the object isn't owned (receivers)
+        SubscriptionId id;
+    };
+
+    class BaseEventChannel
+    {
+    public:
+        virtual ~BaseEventChannel();
+        virtual void swap() = 0;
+        virtual void setThreadCount(unsigned int threadCount) = 0;
+        virtual void merge(std::pmr::memory_resource &scratch) = 0;
+        // returns whether there were events to dispatch
+        virtual bool dispatch() = 0;
+        virtual void compact() = 0;
+
+        bool unsubscribe(SubscriptionId id);
+
+        std::vector<Handler> immediateHandlers;
+        std::vector<Handler> deferredHandlers;
+
+        // number of emitted events the deferred handlers have been called for
+        unsigned int dispatched = 0;
+    };
+
+    template <typename T>
+    class EventChannel : public BaseEventChannel
+    {
+    public:
+        EventChannel(unsigned int threadCount, std::pmr::memory_resource *resource) : emitted(resource), readable(resource), resource(resource)
+        {
+            setThreadCount(threadCount);
+        }
+
+        void swap()
+        {
+            // keep the memory of both buffers around so steady event traffic doesn't allocate
+            readable.clear();
+            readable.swap(emitted);
+            dispatched = 0;
+        }
+
+        bool dispatch()
+        {
+            const auto any = dispatched < emitted.getSize();
+
+            // handlers might emit more events (which might move the buffer), so the event is looked up for each call
+            for (; dispatched < emitted.getSize(); ++dispatched) {
+                for (std::size_t i = 0; i < deferredHandlers.size(); ++i) {
+                    deferredHandlers[i].invoke(deferredHandlers[i].object, &emitted[dispatched]);
+                }
+            }
+
+            return any;
+        }
+
+        // calls the immediate handlers for an event in buffer
+        void dispatchImmediate(Pool<T> &buffer, unsigned int index)
+        {
+            for (std::size_t i = 0; i < immediateHandlers.size(); ++i) {
+                immediateHandlers[i].invoke(immediateHandlers[i].object, &buffer[index]);
+            }
+        }
+
+        void compact()
+        {
+            emitted.compact();
+            readable.compact();
+            for (auto &buffer : threadBuffers) {
+                buffer.events.compact();
+                buffer.runs.shrink_to_fit();
+            }
+        }
+
+        void setThreadCount(unsigned int threadCount)
+        {
+            while (threadBuffers.size() < threadCount) {
+                threadBuffers.emplace_back(resource);
+            }
+        }
+
+        template <typename ... Args>
+        void emitConcurrent(Args && ... args)
+        {
+            const auto threadIndex = ThreadPool::getThreadIndex();
+            assert(threadIndex < threadBuffers.size());
+            auto &buffer = threadBuffers[threadIndex];
+
+            buffer.events.emplace(std::forward<Args>(args) ...);
+
+            const auto key = getEmitKey();
+            if (buffer.runs.empty() || buffer.runs.back().key != key) {
+                buffer.runs.push_back({ key, buffer.events.getSize() - 1, 0 });
+            }
+            buffer.runs.back().end = buffer.events.getSize();
+
+            if (!immediateHandlers.empty()) {
+                dispatchImmediate(buffer.events, buffer.events.getSize() - 1);
+            }
+        }
+
+        // scratch holds the temporary data of the merge
+        void merge(std::pmr::memory_resource &scratch)
+        {
+            // a key is only ever emitted from one thread at a time, so sorting the runs by key (stable) gives a deterministic order
+            std::pmr::vector<std::pair<unsigned int, Run>> runs(&scratch);
+            for (unsigned int thread = 0; thread < threadBuffers.size(); ++thread) {
+                for (const auto &run : threadBuffers[thread].runs) {
+                    runs.push_back(std::make_pair(thread, run));
+                }
+            }
+            std::stable_sort(runs.begin(), runs.end(), [](const std::pair<unsigned int, Run> &a, const std::pair<unsigned int, Run> &b) {
+                return a.second.key < b.second.key;
+            });
+
+            for (const auto &run : runs) {
+                auto &events = threadBuffers[run.first].events;
+                for (auto i = run.second.begin; i < run.second.end; ++i) {
+                    emitted.add(std::move(events[i]));
+                }
+            }
+
+            for (auto &buffer : threadBuffers) {
+                buffer.events.clear();
+                buffer.runs.clear();
+            }
+        }
+
+        Pool<T> emitted;
+        Pool<T> readable;
+
+    private:
+        // consecutive events a thread emitted with the same key
+        struct Run
+        {
+            std::uint64_t key;
+            unsigned int begin;
+            unsigned int end;
+        };
+
+        // aligned so that threads appending to their own buffers don't share cache lines
+        struct alignas(CACHE_LINE_SIZE) ThreadBuffer
+        {
+            ThreadBuffer(std::pmr::memory_resource *resource) : events(resource), runs(resource) {}
+
+            Pool<T> events;
+            std::pmr::vector<Run> runs;
+        };
+
+        // vector index = thread index
+        std::vector<ThreadBuffer> threadBuffers;
+
+        std::pmr::memory_resource *resource;
+    };
+
     template <typename T>
-    std::shared_ptr<Pool<T>> accommodateEvent();
+    EventChannel<T>* accommodateEvent();
+
+    template <typename T>
+    SubscriptionId addHandler(Handler handler, Dispatch dispatch);
+
+    // indexed by event id, null if no event of the type has been emitted (channels are created lock-free, see accommodateEvent)
+    std::unique_ptr<std::atomic<BaseEventChannel*>[]> channels;
 
-    std::unordered_map<std::type_index, std::shared_ptr<BasePool>> eventPools;
+    bool concurrent = false;
+    unsigned int threadCount = 1;
+    std::atomic<unsigned int> emittedCount{0};
+
+    // the next batch number reserveBatches hands out (0 is the key of threads outside any scope)
+    std::atomic<std::uint32_t> nextBatch{1};
+    SubscriptionId nextSubscriptionId = 1;
+
+    std::pmr::memory_resource *resource;
 
     World &world;
 };
@@ -58,32 +352,97 @@ private:
 template <typename T>
 void EventManager::emitEvent(T event)
 {
-    std::shared_ptr<Pool<T>> eventPool = accommodateEvent<T>();
-    eventPool->add(event);
+    emitEvent<T, T>(std::move(event));
 }
 
 template <typename T, typename ... Args>
 void EventManager::emitEvent(Args && ... args)
 {
-    T event(std::forward<Args>(args) ...);
-    emitEvent<T>(event);
+    auto *channel = accommodateEvent<T>();
+
+    if (PROFILING) {
+        emittedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (concurrent) {
+        channel->emitConcurrent(std::forward<Args>(args) ...);
+    }
+    else {
+        channel->emitted.emplace(std::forward<Args>(args) ...);
+
+        if (!channel->immediateHandlers.empty()) {
+            channel->dispatchImmediate(channel->emitted, channel->emitted.getSize() - 1);
+        }
+    }
+}
+
+template <typename T, typename F>
+EventManager::SubscriptionId EventManager::subscribe(F &&f, Dispatch dispatch)
+{
+    using Callable = std::decay_t<F>;
+
+    Handler handler;
+    handler.object = new Callable(std::forward<F>(f));
+    handler.invoke = [](void *object, const void *event) { (*static_cast<Callable*>(object))(*static_cast<const T*>(event)); };
+    handler.destroy = [](void *object) { delete static_cast<Callable*>(object); };
+    return addHandler<T>(handler, dispatch);
+}
+
+template <typename T, typename R>
+EventManager::SubscriptionId EventManager::subscribeReceiver(R &receiver, Dispatch dispatch)
+{
+    Handler handler;
+    handler.object = &receiver;
+    handler.invoke = [](void *object, const void *event) { static_cast<R*>(object)->receive(*static_cast<const T*>(event)); };
+    handler.destroy = nullptr;
+    return addHandler<T>(handler, dispatch);
+}
+
+template <typename T>
+EventManager::SubscriptionId EventManager::addHandler(Handler handler, Dispatch dispatch)
+{
+    assert(!concurrent);
+    auto *channel = accommodateEvent<T>();
+
+    handler.id = nextSubscriptionId++;
+    if (dispatch == Dispatch::Immediate) {
+        channel->immediateHandlers.push_back(handler);
+    }
+    else {
+        channel->deferredHandlers.push_back(handler);
+    }
+
+    return handler.id;
 }
 
 template <typename T>
-std::shared_ptr<Pool<T>> EventManager::accommodateEvent()
+EventManager::EventChannel<T>* EventManager::accommodateEvent()
 {
-    if (eventPools.find(std::type_index(typeid(T))) == eventPools.end()) {
-        std::shared_ptr<Pool<T>> pool(new Pool<T>());
-        eventPools.insert(std::make_pair(std::type_index(typeid(T)), pool));
+    auto &slot = channels[Event<T>::getId()];
+    auto *channel = slot.load(std::memory_order_acquire);
+
+    if (!channel) {
+        // two threads might emit the first event of a type at the same time, the one that loses the race uses the winner's channel
+        std::unique_ptr<BaseEventChannel> created(new EventChannel<T>(threadCount, resource));
+        if (slot.compare_exchange_strong(channel, created.get(), std::memory_order_acq_rel)) {
+            channel = created.release();
+        }
     }
 
-    return std::static_pointer_cast<Pool<T>>(eventPools[std::type_index(typeid(T))]);
+    return static_cast<EventChannel<T>*>(channel);
 }
 
 template <typename T>
-std::vector<T> EventManager::getEvents()
+EventRange<T> EventManager::getEvents() const
 {
-    return std::static_pointer_cast<Pool<T>>(eventPools[std::type_index(typeid(T))]).getData();
+    const auto *channel = channels[Event<T>::getId()].load(std::memory_order_acquire);
+
+    if (!channel) {
+        return EventRange<T>();
+    }
+
+    const auto &events = static_cast<const EventChannel<T>*>(channel)->readable;
+    return EventRange<T>(events.getData(), events.getData() + events.getSize());
 }
 
 }
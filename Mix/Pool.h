@@ -1,6 +1,16 @@
 #pragma once
 
+#include "Config.h"
+#include "Profiler.h"
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <typeinfo>
+#include <cstdint>
 #include <cassert>
 
 namespace Mix
@@ -12,20 +22,29 @@ class AbstractPool
 public:
     virtual ~AbstractPool() {}
     virtual void clear() = 0;
+
+    // releases the memory that isn't needed for the objects currently stored
+    virtual void compact() = 0;
 };
 
-// A pool is just a vector (contiguous data) of objects of type T.
+// A pool is just a vector (contiguous data) of objects of type T, allocated from a memory resource.
 template <typename T>
 class Pool : public AbstractPool
 {
 public:
-    Pool(int size = DEFAULT_POOL_SIZE)
+    Pool(int size = DEFAULT_POOL_SIZE) : Pool(std::pmr::get_default_resource(), size) {}
+
+    explicit Pool(std::pmr::memory_resource *resource, int size = DEFAULT_POOL_SIZE) : data(resource)
     {
-        resize(size);
+        data.reserve(size);
     }
 
     virtual ~Pool() {}
 
+    // moving keeps the memory resource (copying would fall back to the default one)
+    Pool(Pool&&) = default;
+    Pool& operator=(Pool&&) = default;
+
     bool isEmpty() const
     {
         return data.empty();
@@ -38,7 +57,16 @@ public:
 
     void resize(int n)
     {
+        const auto capacity = data.capacity();
         data.resize(n);
+        profileGrowth(capacity);
+    }
+
+    void reserve(unsigned int n)
+    {
+        const auto capacity = data.capacity();
+        data.reserve(n);
+        profileGrowth(capacity);
     }
 
     void clear()
@@ -46,10 +74,15 @@ public:
         data.clear();
     }
 
+    void compact()
+    {
+        data.shrink_to_fit();
+    }
+
     bool set(unsigned int index, T object)
     {
         assert(index < getSize());
-        data[index] = object;
+        data[index] = std::move(object);
         return true;
     }
 
@@ -61,7 +94,22 @@ public:
 
     void add(T object)
     {
-        data.push_back(object);
+        emplace(std::move(object));
+    }
+
+    template <typename ... Args>
+    T& emplace(Args && ... args)
+    {
+        const auto capacity = data.capacity();
+        data.emplace_back(std::forward<Args>(args) ...);
+        profileGrowth(capacity);
+        return data.back();
+    }
+
+    void removeLast()
+    {
+        assert(!isEmpty());
+        data.pop_back();
     }
 
     T& operator[](unsigned int index)
@@ -74,13 +122,418 @@ public:
         return data[index];
     }
 
-    std::vector<T> getData()
+    T* getData() { return data.data(); }
+    const T* getData() const { return data.data(); }
+
+    // exchanges the contents (and the allocated memory) of the pools, which must use the same memory resource
+    void swap(Pool &other)
+    {
+        assert(*data.get_allocator().resource() == *other.data.get_allocator().resource());
+        data.swap(other.data);
+    }
+
+private:
+    // records that the vector reallocated (see Profiler)
+    void profileGrowth(std::size_t previousCapacity)
+    {
+        if (PROFILING && data.capacity() != previousCapacity) {
+            Profiler::get().recordPoolGrowth(typeid(T).name(), previousCapacity, data.capacity());
+        }
+    }
+
+    std::pmr::vector<T> data;
+};
+
+/*
+    A pool of objects of type T kept in fixed-size pages that are allocated on demand.
+    Adding objects never moves the others (references stay valid) and growing allocates one page instead of copying the pool,
+    but the objects are only contiguous within a page.
+*/
+template <typename T>
+class PagedPool : public AbstractPool
+{
+public:
+    explicit PagedPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : pages(resource) {}
+
+    virtual ~PagedPool()
+    {
+        clear();
+        freePages(0);
+    }
+
+    PagedPool(const PagedPool&) = delete;
+    PagedPool& operator=(const PagedPool&) = delete;
+
+    bool isEmpty() const
+    {
+        return size == 0;
+    }
+
+    unsigned int getSize() const
+    {
+        return size;
+    }
+
+    void reserve(unsigned int n)
+    {
+        while (pages.size() * PageSize < n) {
+            addPage();
+        }
+    }
+
+    // destroys the objects, the pages are kept
+    void clear()
+    {
+        while (size > 0) {
+            removeLast();
+        }
+    }
+
+    // frees the pages after the last object
+    void compact()
+    {
+        freePages((size + PageSize - 1) / PageSize);
+        pages.shrink_to_fit();
+    }
+
+    T& get(unsigned int index)
+    {
+        assert(index < getSize());
+        return (*this)[index];
+    }
+
+    void add(T object)
+    {
+        emplace(std::move(object));
+    }
+
+    template <typename ... Args>
+    T& emplace(Args && ... args)
+    {
+        if (size == pages.size() * PageSize) {
+            addPage();
+        }
+
+        auto *object = new (&pages[size / PageSize]->objects[size % PageSize]) T(std::forward<Args>(args) ...);
+        ++size;
+        return *object;
+    }
+
+    void removeLast()
+    {
+        assert(!isEmpty());
+        --size;
+        (*this)[size].~T();
+    }
+
+    T& operator[](unsigned int index)
+    {
+        return *std::launder(reinterpret_cast<T*>(&pages[index / PageSize]->objects[index % PageSize]));
+    }
+
+    const T& operator[](unsigned int index) const
+    {
+        return *std::launder(reinterpret_cast<const T*>(&pages[index / PageSize]->objects[index % PageSize]));
+    }
+
+private:
+    static const unsigned int PageSize = COMPONENT_PAGE_SIZE;
+
+    // uninitialized storage, objects [0, size) are constructed
+    struct Page
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type objects[PageSize];
+    };
+
+    void addPage()
+    {
+        auto *resource = pages.get_allocator().resource();
+        pages.push_back(static_cast<Page*>(resource->allocate(sizeof(Page), alignof(Page))));
+
+        if (PROFILING) {
+            Profiler::get().recordPoolGrowth(typeid(T).name(), (pages.size() - 1) * PageSize, pages.size() * PageSize);
+        }
+    }
+
+    // frees the pages from the first one on
+    void freePages(std::size_t first)
+    {
+        auto *resource = pages.get_allocator().resource();
+        for (auto i = first; i < pages.size(); ++i) {
+            resource->deallocate(pages[i], sizeof(Page), alignof(Page));
+        }
+        pages.resize(std::min(first, pages.size()));
+    }
+
+    // pages are allocated from the memory resource of the vector
+    std::pmr::vector<Page*> pages;
+    unsigned int size = 0;
+};
+
+/*
+    Specialize to choose how the components of type T are stored (sparse storage), e.g.
+
+    template <>
+    struct Mix::PoolTraits<ParticleComponent>
+    {
+        static const bool paged = true;
+    };
+
+    Paged pools (see PagedPool) never move components when growing, so references from getComponent stay valid while components
+    are added. Removing a component still moves the pool's last component into its place. Unpaged pools keep the components
+    contiguous, which is a little faster to iterate. PAGED_COMPONENT_POOLS in Config.h sets the default.
+*/
+template <typename T>
+struct PoolTraits
+{
+    static const bool paged = PAGED_COMPONENT_POOLS != 0;
+};
+
+// Maps entity indices to slots in a packed array.
+// The sparse array is split into pages that are only allocated once an index within them is used,
+// so memory scales with the entities actually stored rather than with the largest entity index.
+class SparseIndex
+{
+public:
+    static const std::uint32_t Invalid = 0xffffffff;
+
+    explicit SparseIndex(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : pages(resource) {}
+
+    ~SparseIndex()
+    {
+        clear();
+    }
+
+    SparseIndex(const SparseIndex&) = delete;
+    SparseIndex& operator=(const SparseIndex&) = delete;
+
+    bool contains(std::uint32_t index) const
+    {
+        return get(index) != Invalid;
+    }
+
+    // returns the slot of the index, or Invalid if the index isn't stored
+    std::uint32_t get(std::uint32_t index) const
+    {
+        const auto page = index / PageSize;
+        if (page >= pages.size() || !pages[page]) {
+            return Invalid;
+        }
+        return pages[page][index % PageSize];
+    }
+
+    void set(std::uint32_t index, std::uint32_t slot)
+    {
+        const auto page = index / PageSize;
+        if (page >= pages.size()) {
+            pages.resize(page + 1);
+        }
+        if (!pages[page]) {
+            pages[page] = static_cast<std::uint32_t*>(pages.get_allocator().resource()->allocate(PageBytes, alignof(std::uint32_t)));
+            std::fill(pages[page], pages[page] + PageSize, std::uint32_t(Invalid));
+        }
+        pages[page][index % PageSize] = slot;
+    }
+
+    void remove(std::uint32_t index)
+    {
+        assert(contains(index));
+        pages[index / PageSize][index % PageSize] = Invalid;
+    }
+
+    void clear()
+    {
+        for (auto *page : pages) {
+            freePage(page);
+        }
+        pages.clear();
+    }
+
+    // frees the pages that don't hold any index anymore
+    void compact()
+    {
+        for (auto &page : pages) {
+            if (page && std::all_of(page, page + PageSize, [](std::uint32_t slot) { return slot == Invalid; })) {
+                freePage(page);
+                page = nullptr;
+            }
+        }
+
+        while (!pages.empty() && !pages.back()) {
+            pages.pop_back();
+        }
+        pages.shrink_to_fit();
+    }
+
+private:
+    static const std::uint32_t PageSize = SPARSE_PAGE_SIZE;
+    static const std::size_t PageBytes = PageSize * sizeof(std::uint32_t);
+
+    void freePage(std::uint32_t *page)
+    {
+        if (page) {
+            pages.get_allocator().resource()->deallocate(page, PageBytes, alignof(std::uint32_t));
+        }
+    }
+
+    // vector of pages, a page is null until one of its indices is used (pages are allocated from the memory resource of the vector)
+    std::pmr::vector<std::uint32_t*> pages;
+};
+
+// Component pools are addressed by entity index and must be able to drop an entity's component without knowing its type.
+class AbstractComponentPool : public AbstractPool
+{
+public:
+    virtual bool has(unsigned int index) const = 0;
+    virtual void remove(unsigned int index) = 0;
+
+    // copies the component of an entity index to each of the entity indices (which must not have the component yet)
+    virtual void copy(unsigned int index, const std::uint32_t *indices, unsigned int count) = 0;
+};
+
+/*
+    A sparse set of components of type T.
+    Components are kept packed in a dense array (along with the entity index that owns each of them),
+    and a sparse index maps an entity index to the component's position in the dense array.
+    Removal swaps the last component into the hole, so the dense array never has gaps.
+*/
+template <typename T>
+class SparsePool : public AbstractComponentPool
+{
+public:
+    explicit SparsePool(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : components(resource), indices(resource), sparse(resource) {}
+
+    virtual ~SparsePool() {}
+
+    bool isEmpty() const
+    {
+        return components.isEmpty();
+    }
+
+    // returns the number of components stored (not the largest entity index)
+    unsigned int getSize() const
+    {
+        return components.getSize();
+    }
+
+    void reserve(unsigned int n)
+    {
+        components.reserve(n);
+        indices.reserve(n);
+    }
+
+    void clear()
+    {
+        components.clear();
+        indices.clear();
+        sparse.clear();
+    }
+
+    void compact()
+    {
+        components.compact();
+        indices.shrink_to_fit();
+        sparse.compact();
+    }
+
+    bool has(unsigned int index) const
+    {
+        return sparse.contains(index);
+    }
+
+    // constructs a component for the entity index in place, or replaces the one it already has
+    template <typename ... Args>
+    T& emplace(unsigned int index, Args && ... args)
     {
-        return data;
+        const auto slot = sparse.get(index);
+        if (slot != SparseIndex::Invalid) {
+            components[slot] = T(std::forward<Args>(args) ...);
+            return components[slot];
+        }
+
+        auto &component = components.emplace(std::forward<Args>(args) ...);
+        indices.push_back(index);
+        sparse.set(index, components.getSize() - 1);
+        return component;
+    }
+
+    T& get(unsigned int index)
+    {
+        const auto slot = sparse.get(index);
+        assert(slot != SparseIndex::Invalid);
+        return components[slot];
+    }
+
+    const T& get(unsigned int index) const
+    {
+        const auto slot = sparse.get(index);
+        assert(slot != SparseIndex::Invalid);
+        return components[slot];
     }
 
+    void remove(unsigned int index)
+    {
+        const auto slot = sparse.get(index);
+        assert(slot != SparseIndex::Invalid);
+        const auto last = components.getSize() - 1;
+
+        if (slot != last) {
+            components[slot] = std::move(components[last]);
+            indices[slot] = indices[last];
+            sparse.set(indices[slot], slot);
+        }
+
+        components.removeLast();
+        indices.pop_back();
+        sparse.remove(index);
+    }
+
+    void copy(unsigned int index, const std::uint32_t *indices, unsigned int count)
+    {
+        if constexpr (std::is_copy_constructible<T>::value) {
+            // reserve first, so that the object we copy from doesn't move
+            reserve(getSize() + count);
+            fill(indices, count, get(index));
+        }
+        else {
+            assert(false && "component type can't be copied");
+        }
+    }
+
+    // adds a copy of the object for each of the entity indices (which must not have the component yet)
+    void fill(const std::uint32_t *indices, unsigned int count, const T &object)
+    {
+        const auto first = components.getSize();
+        components.reserve(first + count);
+        for (unsigned int i = 0; i < count; ++i) {
+            components.emplace(object);
+        }
+        this->indices.insert(this->indices.end(), indices, indices + count);
+
+        for (unsigned int i = 0; i < count; ++i) {
+            assert(!has(indices[i]));
+            sparse.set(indices[i], first + i);
+        }
+    }
+
+    /*
+        Packed access, i.e. iterate from 0 to getSize() to walk only the stored components.
+        getIndex(i) is the entity index that owns the component getPacked(i).
+    */
+    T& getPacked(unsigned int i) { return components[i]; }
+    const T& getPacked(unsigned int i) const { return components[i]; }
+    unsigned int getIndex(unsigned int i) const { return indices[i]; }
+
 private:
-    std::vector<T> data;
+    // packed components, in pages or contiguous depending on PoolTraits<T>
+    std::conditional_t<PoolTraits<T>::paged, PagedPool<T>, Pool<T>> components;
+
+    // entity index of each packed component (same order as components)
+    std::pmr::vector<std::uint32_t> indices;
+
+    // entity index -> position in components
+    SparseIndex sparse;
 };
 
 }
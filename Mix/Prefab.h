@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Component.h"
+#include "Entity.h"
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+namespace Mix
+{
+
+/*
+    A prefab is a set of component values that can be instantiated many times (see World::instantiate).
+    Each instantiation copies the values straight into the component storage, one pass per component type.
+
+    Example:
+
+    Mix::Prefab bullet;
+    bullet.add<PositionComponent>(0, 0).add<VelocityComponent>(0, 10);
+    auto bullets = world.instantiate(bullet, 100);
+*/
+class Prefab
+{
+public:
+    // sets the value of a component (replaces the value if the prefab already has the component)
+    template <typename T, typename ... Args>
+    Prefab& add(Args && ... args);
+
+    template <typename T>
+    bool has() const;
+
+    const ComponentMask& getComponentMask() const { return componentMask; }
+
+private:
+    struct BaseComponentValue
+    {
+        BaseComponentValue(BaseComponent::Id componentId) : componentId(componentId) {}
+        virtual ~BaseComponentValue() {}
+
+        // copies the value to the component pool for each of the entity indices (sparse storage)
+        virtual void fill(EntityManager &entityManager, const std::uint32_t *indices, unsigned int count) const = 0;
+
+        virtual const void* getValue() const = 0;
+
+        BaseComponent::Id componentId;
+    };
+
+    template <typename T>
+    struct ComponentValue : BaseComponentValue
+    {
+        template <typename ... Args>
+        ComponentValue(Args && ... args) : BaseComponentValue(Component<T>::getId()), value(std::forward<Args>(args) ...) {}
+
+        void fill(EntityManager &entityManager, const std::uint32_t *indices, unsigned int count) const
+        {
+            entityManager.accommodateComponent<T>()->fill(indices, count, value);
+        }
+
+        const void* getValue() const { return &value; }
+
+        T value;
+    };
+
+    ComponentMask componentMask;
+    std::vector<std::unique_ptr<BaseComponentValue>> components;
+
+    friend class EntityManager;
+};
+
+template <typename T, typename ... Args>
+Prefab& Prefab::add(Args && ... args)
+{
+    const auto componentId = Component<T>::getId();
+    std::unique_ptr<BaseComponentValue> component(new ComponentValue<T>(std::forward<Args>(args) ...));
+
+    if (componentMask.test(componentId)) {
+        for (auto &it : components) {
+            if (it->componentId == componentId) {
+                it = std::move(component);
+                break;
+            }
+        }
+    }
+    else {
+        components.push_back(std::move(component));
+        componentMask.set(componentId);
+    }
+
+    return *this;
+}
+
+template <typename T>
+bool Prefab::has() const
+{
+    return componentMask.test(Component<T>::getId());
+}
+
+}
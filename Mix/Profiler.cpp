@@ -0,0 +1,149 @@
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <algorithm>
+
+namespace Mix
+{
+
+namespace
+{
+
+std::int64_t getClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// writes a string as a JSON string (type names might contain quotes or backslashes on some compilers)
+void writeString(std::ostream &out, const char *s)
+{
+    out << '"';
+    for (; s && *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        out << *s;
+    }
+    out << '"';
+}
+
+// writes nanoseconds as microseconds with 3 decimals (trace event times are in microseconds),
+// as integers so that long-running traces keep nanosecond resolution
+void writeMicroseconds(std::ostream &out, std::uint64_t nanoseconds)
+{
+    const auto fraction = nanoseconds % 1000;
+    out << nanoseconds / 1000 << '.' << char('0' + fraction / 100) << char('0' + fraction / 10 % 10) << char('0' + fraction % 10);
+}
+
+}
+
+Profiler& Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : records(new ProfileRecord[BufferSize]), epoch(getClock())
+{
+}
+
+std::uint64_t Profiler::now() const
+{
+    return std::uint64_t(getClock() - epoch);
+}
+
+void Profiler::recordSystem(const char *name, std::uint64_t start, std::uint64_t end, std::uint64_t entityCount)
+{
+    record({ ProfileRecord::Type::System, name, ThreadPool::getThreadIndex(), start, end - start, { entityCount, 0, 0 } });
+}
+
+void Profiler::recordFrame(std::uint64_t start, std::uint64_t end, std::uint64_t createdCount, std::uint64_t destroyedCount, std::uint64_t eventCount)
+{
+    record({ ProfileRecord::Type::Frame, "World::update", ThreadPool::getThreadIndex(), start, end - start, { createdCount, destroyedCount, eventCount } });
+}
+
+void Profiler::recordPoolGrowth(const char *name, std::uint64_t oldCapacity, std::uint64_t newCapacity)
+{
+    record({ ProfileRecord::Type::PoolGrowth, name, ThreadPool::getThreadIndex(), now(), 0, { oldCapacity, newCapacity, 0 } });
+}
+
+void Profiler::record(const ProfileRecord &record)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    const auto position = next.fetch_add(1, std::memory_order_relaxed);
+    records[position % BufferSize] = record;
+}
+
+std::vector<ProfileRecord> Profiler::getRecords() const
+{
+    const auto last = next.load(std::memory_order_acquire);
+    const auto first = last > BufferSize ? last - BufferSize : 0;
+
+    std::vector<ProfileRecord> result;
+    result.reserve(last - first);
+    for (auto position = first; position < last; ++position) {
+        result.push_back(records[position % BufferSize]);
+    }
+    return result;
+}
+
+ProfileRecord Profiler::getLastFrame() const
+{
+    const auto last = next.load(std::memory_order_acquire);
+    const auto first = last > BufferSize ? last - BufferSize : 0;
+
+    for (auto position = last; position > first; --position) {
+        const auto &record = records[(position - 1) % BufferSize];
+        if (record.type == ProfileRecord::Type::Frame) {
+            return record;
+        }
+    }
+
+    return { ProfileRecord::Type::Frame, "World::update", 0, 0, 0, { 0, 0, 0 } };
+}
+
+void Profiler::clear()
+{
+    next.store(0, std::memory_order_release);
+}
+
+void Profiler::writeChromeTrace(std::ostream &out) const
+{
+    out << "{\"traceEvents\":[";
+
+    bool first = true;
+    for (const auto &record : getRecords()) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+
+        out << "{\"name\":";
+        writeString(out, record.name);
+        out << ",\"pid\":0,\"tid\":" << record.thread << ",\"ts\":";
+        writeMicroseconds(out, record.start);
+
+        switch (record.type) {
+        case ProfileRecord::Type::System:
+            out << ",\"cat\":\"system\",\"ph\":\"X\",\"dur\":";
+            writeMicroseconds(out, record.duration);
+            out << ",\"args\":{\"entities\":" << record.counts[0] << "}}";
+            break;
+        case ProfileRecord::Type::Frame:
+            out << ",\"cat\":\"frame\",\"ph\":\"X\",\"dur\":";
+            writeMicroseconds(out, record.duration);
+            out << ",\"args\":{\"created\":" << record.counts[0] << ",\"destroyed\":" << record.counts[1]
+                << ",\"events\":" << record.counts[2] << "}}";
+            break;
+        case ProfileRecord::Type::PoolGrowth:
+            out << ",\"cat\":\"pool\",\"ph\":\"i\",\"s\":\"t\""
+                << ",\"args\":{\"oldCapacity\":" << record.counts[0] << ",\"newCapacity\":" << record.counts[1] << "}}";
+            break;
+        }
+    }
+
+    out << "\n]}\n";
+}
+
+}
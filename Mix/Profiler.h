@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Config.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+namespace Mix
+{
+
+// One measurement taken by the profiler.
+struct ProfileRecord
+{
+    enum class Type : std::uint8_t
+    {
+        System,         // a system update: counts[0] = entities in the system's list
+        Frame,          // a World::update: counts = entities created, entities destroyed, events emitted during the frame
+        PoolGrowth      // a pool allocated more memory: counts[0] = old capacity, counts[1] = new capacity (objects)
+    };
+
+    Type type;
+
+    // the system or stored type (typeid name), or "World::update" for frames
+    const char *name;
+
+    // thread index (see ThreadPool::getThreadIndex)
+    std::uint32_t thread;
+
+    // nanoseconds since the profiler started, and how long it took (0 for pool growth)
+    std::uint64_t start;
+    std::uint64_t duration;
+
+    std::uint64_t counts[3];
+};
+
+/*
+    Collects the time each system update and each World::update take (along with entity and event counts), and when pools grow.
+    Records go into a ring buffer of PROFILER_BUFFER_SIZE records that keeps the most recent ones, recording is lock-free.
+
+    Set PROFILING in Config.h to 1 to compile the instrumentation in, with 0 (the default) it costs nothing. Recording can be
+    paused at runtime with setEnabled. Query or export the records between frames (not while systems are updating), e.g.
+
+    std::ofstream file("trace.json");
+    Mix::Profiler::get().writeChromeTrace(file);    // open in chrome://tracing or Perfetto
+*/
+class Profiler
+{
+public:
+    static Profiler& get();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // nanoseconds since the profiler started
+    std::uint64_t now() const;
+
+    void setEnabled(bool enabled) { this->enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void recordSystem(const char *name, std::uint64_t start, std::uint64_t end, std::uint64_t entityCount);
+    void recordFrame(std::uint64_t start, std::uint64_t end, std::uint64_t createdCount, std::uint64_t destroyedCount, std::uint64_t eventCount);
+    void recordPoolGrowth(const char *name, std::uint64_t oldCapacity, std::uint64_t newCapacity);
+
+    // returns the records in the ring buffer, oldest first
+    std::vector<ProfileRecord> getRecords() const;
+
+    // returns the most recent frame record, or a record with zero counts if no frame has been recorded
+    ProfileRecord getLastFrame() const;
+
+    // forgets all records
+    void clear();
+
+    // writes the records as Chrome trace event JSON
+    void writeChromeTrace(std::ostream &out) const;
+
+private:
+    Profiler();
+
+    void record(const ProfileRecord &record);
+
+    static const unsigned int BufferSize = PROFILER_BUFFER_SIZE;
+
+    // slot = position % buffer size, positions only grow
+    std::unique_ptr<ProfileRecord[]> records;
+    std::atomic<std::uint64_t> next{0};
+
+    std::atomic<bool> enabled{true};
+
+    // steady clock time the profiler started at (nanoseconds)
+    std::int64_t epoch;
+};
+
+}
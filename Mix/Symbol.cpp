@@ -0,0 +1,49 @@
+#include "Symbol.h"
+#include <unordered_map>
+#include <mutex>
+#include <cassert>
+
+namespace Mix
+{
+
+namespace
+{
+
+// interned names by symbol id, only touched when interning (and by getName)
+struct SymbolNames
+{
+    std::mutex mutex;
+    std::unordered_map<Symbol::Id, std::string> names;
+};
+
+SymbolNames& getSymbolNames()
+{
+    static SymbolNames symbolNames;
+    return symbolNames;
+}
+
+}
+
+Symbol Symbol::intern(const std::string &name)
+{
+    const Symbol symbol(name);
+    auto &symbolNames = getSymbolNames();
+
+    std::lock_guard<std::mutex> lock(symbolNames.mutex);
+    const auto it = symbolNames.names.emplace(symbol.id, name).first;
+    assert(it->second == name && "two symbol names have the same hash");
+    (void)it;
+
+    return symbol;
+}
+
+std::string Symbol::getName() const
+{
+    auto &symbolNames = getSymbolNames();
+
+    std::lock_guard<std::mutex> lock(symbolNames.mutex);
+    const auto it = symbolNames.names.find(id);
+    return it != symbolNames.names.end() ? it->second : std::string();
+}
+
+}
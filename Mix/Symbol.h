@@ -0,0 +1,62 @@
+#pragma once
+
+#include "TypeRegistry.h"
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace Mix
+{
+
+/*
+    An interned string (e.g. a tag or group name), i.e. just the FNV-1a hash of the string (see TypeInfo::hash).
+    Symbols are compared and hashed as integers and the string is never looked at again. The hash of a literal is computed at
+    compile time when the symbol is constexpr, so hot code should keep its symbols around rather than pass strings:
+
+    constexpr Mix::Symbol PlayerTag = "player";
+    static const auto Enemies = Mix::Symbol::intern(name);  // registers the name, see getName
+
+    Two different strings having the same 64-bit hash is caught when the second one is interned (assert).
+*/
+class Symbol
+{
+public:
+    using Id = std::uint64_t;
+
+    constexpr Symbol() : id(0) {}
+    constexpr Symbol(const char *name) : id(TypeInfo::hash(name)) {}
+    Symbol(const std::string &name) : id(TypeInfo::hash(name.c_str())) {}
+
+    // hashes the name and remembers it (thread-safe), so that getName can return it
+    static Symbol intern(const std::string &name);
+
+    constexpr bool operator==(const Symbol &s) const { return id == s.id; }
+    constexpr bool operator!=(const Symbol &s) const { return id != s.id; }
+    constexpr bool operator<(const Symbol &s) const { return id < s.id; }
+
+    constexpr Id getId() const { return id; }
+
+    // returns the interned name of the symbol, or an empty string if it was never interned (meant for debugging)
+    std::string getName() const;
+
+private:
+    Id id;
+};
+
+}
+
+namespace std
+{
+
+template <>
+struct hash<Mix::Symbol>
+{
+    // the id is already a hash
+    std::size_t operator()(const Mix::Symbol &s) const
+    {
+        return std::size_t(s.getId());
+    }
+};
+
+}
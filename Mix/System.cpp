@@ -1,20 +1,73 @@
 #include "System.h"
 #include "World.h"
 #include <algorithm>
+#include <atomic>
+#include <functional>
 
 namespace Mix
 {
 
+namespace
+{
+
+// the memory resource of the SystemManager constructing a system on the thread (see SystemManager::addSystem)
+thread_local std::pmr::memory_resource *constructingResource = nullptr;
+
+std::pmr::memory_resource* getConstructingResource()
+{
+    return constructingResource ? constructingResource : std::pmr::get_default_resource();
+}
+
+}
+
+System::System() : entities(getConstructingResource()), entityPositions(getConstructingResource())
+{
+}
+
+System::ResourceScope::ResourceScope(std::pmr::memory_resource *resource) : previousResource(constructingResource)
+{
+    constructingResource = resource;
+}
+
+System::ResourceScope::~ResourceScope()
+{
+    constructingResource = previousResource;
+}
+
 void System::addEntity(Entity e)
 {
+    if (hasEntity(e)) {
+        return;
+    }
+
+    entityPositions.set(e.getIndex(), entities.size());
     entities.push_back(e);
 }
 
 void System::removeEntity(Entity e)
 {
-    entities.erase(std::remove_if(entities.begin(), entities.end(),
-        [&e](Entity other) { return e == other; }
-    ), entities.end());
+    if (!hasEntity(e)) {
+        return;
+    }
+
+    const auto position = entityPositions.get(e.getIndex());
+    const auto last = entities.back();
+
+    entities[position] = last;
+    entityPositions.set(last.getIndex(), position);
+    entities.pop_back();
+    entityPositions.remove(e.getIndex());
+}
+
+bool System::hasEntity(Entity e) const
+{
+    const auto position = entityPositions.get(e.getIndex());
+    return position != SparseIndex::Invalid && entities[position] == e;
+}
+
+void System::setWorld(World &world)
+{
+    this->world = &world;
 }
 
 World& System::getWorld() const
@@ -23,27 +76,267 @@ World& System::getWorld() const
     return *world;
 }
 
+EntityManager& System::getEntityManager() const
+{
+    return getWorld().getEntityManager();
+}
+
+EventManager& System::getEventManager() const
+{
+    return getWorld().getEventManager();
+}
+
+ThreadPool& System::getThreadPool() const
+{
+    return getWorld().getThreadPool();
+}
+
+bool System::beginConcurrentPhase()
+{
+    if (getWorld().isConcurrentPhase()) {
+        return false;
+    }
+
+    getWorld().beginConcurrentPhase();
+    return true;
+}
+
+void System::endConcurrentPhase()
+{
+    getWorld().endConcurrentPhase();
+}
+
+void System::compact()
+{
+    entities.shrink_to_fit();
+    entityPositions.compact();
+}
+
 void SystemManager::addToSystems(Entity e)
 {
     const auto &entityComponentMask = world.getEntityManager().getComponentMask(e);
 
-    for (auto &it : systems) {
-        auto &system = it.second;
-        const auto &systemComponentMask = system->getComponentMask();
-        auto interest = (entityComponentMask & systemComponentMask) == systemComponentMask;
+    for (auto *system : getMatchingSystems(entityComponentMask)) {
+        system->addEntity(e);
+    }
+}
 
-        if (interest) {
-            system->addEntity(e);
+void SystemManager::addToSystems(const Entity *first, const Entity *last)
+{
+    auto &entityManager = world.getEntityManager();
+    const ComponentMask *previousMask = nullptr;
+    const std::vector<System*> *matching = nullptr;
+
+    for (auto it = first; it != last; ++it) {
+        const auto &entityComponentMask = entityManager.getComponentMask(*it);
+        if (!previousMask || entityComponentMask != *previousMask) {
+            matching = &getMatchingSystems(entityComponentMask);
+            previousMask = &entityComponentMask;
+        }
+
+        for (auto *system : *matching) {
+            system->addEntity(*it);
         }
     }
 }
 
 void SystemManager::removeFromSystems(Entity e)
 {
-    for (auto &it : systems) {
-        auto &system = it.second;
+    const auto &entityComponentMask = world.getEntityManager().getComponentMask(e);
+
+    // only the systems that were interested in the entity can have it in their lists
+    for (auto *system : getMatchingSystems(entityComponentMask)) {
         system->removeEntity(e);
     }
 }
 
+void SystemManager::removeFromSystems(const Entity *first, const Entity *last)
+{
+    auto &entityManager = world.getEntityManager();
+    const ComponentMask *previousMask = nullptr;
+    const std::vector<System*> *matching = nullptr;
+
+    for (auto it = first; it != last; ++it) {
+        const auto &entityComponentMask = entityManager.getComponentMask(*it);
+        if (!previousMask || entityComponentMask != *previousMask) {
+            matching = &getMatchingSystems(entityComponentMask);
+            previousMask = &entityComponentMask;
+        }
+
+        for (auto *system : *matching) {
+            system->removeEntity(*it);
+        }
+    }
+}
+
+void SystemManager::refreshSystems(Entity e, const ComponentMask &changedComponents)
+{
+    if (matchingDirty) {
+        buildMatching();
+    }
+
+    const auto &entityComponentMask = world.getEntityManager().getComponentMask(e);
+
+    // only the systems that require one of the changed components can change their interest in the entity
+    changedComponents.forEach([&](std::size_t componentId) {
+        for (auto *system : systemsByComponent[componentId]) {
+            if (entityComponentMask.includes(system->getComponentMask())) {
+                system->addEntity(e);
+            }
+            else {
+                system->removeEntity(e);
+            }
+        }
+    });
+}
+
+void SystemManager::compact()
+{
+    for (auto *system : updateOrder) {
+        system->compact();
+    }
+
+    matchingSystems.clear();
+}
+
+void SystemManager::update()
+{
+    if (dependenciesDirty) {
+        buildDependencies();
+    }
+
+    if (updateOrder.size() < 2) {
+        for (unsigned int i = 0; i < updateOrder.size(); ++i) {
+            updateSystem(i);
+        }
+        return;
+    }
+
+    auto &threadPool = world.getThreadPool();
+    ThreadPool::TaskGroup group;
+
+    // events emitted by the systems are keyed by the system's position in the update order
+    world.beginConcurrentPhase();
+
+    // a system is queued once every system it depends on has finished
+    std::pmr::vector<std::atomic<unsigned int>> remainingDependencies(updateOrder.size(), &world.getFrameResource());
+    for (std::size_t i = 0; i < updateOrder.size(); ++i) {
+        remainingDependencies[i].store(dependencyCounts[i], std::memory_order_relaxed);
+    }
+
+    std::function<void(unsigned int)> updateDependents = [&](unsigned int i) {
+        updateSystem(i);
+
+        for (auto dependent : dependents[i]) {
+            if (remainingDependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                threadPool.submit(group, [&updateDependents, dependent] { updateDependents(dependent); });
+            }
+        }
+    };
+
+    for (unsigned int i = 0; i < updateOrder.size(); ++i) {
+        if (dependencyCounts[i] == 0) {
+            threadPool.submit(group, [&updateDependents, i] { updateDependents(i); });
+        }
+    }
+
+    // a system that throws leaves its dependents out of this update, the exception is rethrown once the phase has ended
+    try {
+        threadPool.wait(group);
+    }
+    catch (...) {
+        world.endConcurrentPhase();
+        throw;
+    }
+    world.endConcurrentPhase();
+}
+
+void SystemManager::updateSystem(unsigned int i)
+{
+    auto *system = updateOrder[i];
+    EventManager::EmitScope scope(i + 1, world.getEventManager().reserveBatches(1));
+
+    if (!PROFILING) {
+        system->update();
+        return;
+    }
+
+    auto &profiler = Profiler::get();
+    const auto entityCount = system->getEntities().size();
+    const auto start = profiler.now();
+    system->update();
+    profiler.recordSystem(system->getName(), start, profiler.now(), entityCount);
+}
+
+void SystemManager::addToUpdateOrder(System *system)
+{
+    updateOrder.push_back(system);
+    dependenciesDirty = true;
+    matchingDirty = true;
+}
+
+const std::vector<System*>& SystemManager::getMatchingSystems(const ComponentMask &mask)
+{
+    if (matchingDirty) {
+        buildMatching();
+    }
+
+    auto it = matchingSystems.find(mask);
+    if (it == matchingSystems.end()) {
+        std::vector<System*> matching;
+        for (auto *system : updateOrder) {
+            if (mask.includes(system->getComponentMask())) {
+                matching.push_back(system);
+            }
+        }
+        it = matchingSystems.emplace(mask, std::move(matching)).first;
+    }
+
+    return it->second;
+}
+
+void SystemManager::buildMatching()
+{
+    matchingSystems.clear();
+    systemsByComponent.assign(BaseComponent::MaxComponents, std::vector<System*>());
+
+    for (auto *system : updateOrder) {
+        system->getComponentMask().forEach([&](std::size_t componentId) {
+            systemsByComponent[componentId].push_back(system);
+        });
+    }
+
+    matchingDirty = false;
+}
+
+void SystemManager::buildDependencies()
+{
+    // two systems conflict if one writes to a component the other one accesses
+    auto conflicts = [](const System &a, const System &b) {
+        const auto accessA = a.getReadMask() | a.getWriteMask();
+        const auto accessB = b.getReadMask() | b.getWriteMask();
+
+        if (accessA.none() || accessB.none()) {
+            return true;
+        }
+
+        return a.getWriteMask().intersects(accessB) || b.getWriteMask().intersects(accessA);
+    };
+
+    const auto count = updateOrder.size();
+    dependents.assign(count, std::vector<unsigned int>());
+    dependencyCounts.assign(count, 0);
+
+    for (unsigned int j = 0; j < count; ++j) {
+        for (unsigned int i = 0; i < j; ++i) {
+            if (conflicts(*updateOrder[i], *updateOrder[j])) {
+                dependents[i].push_back(j);
+                ++dependencyCounts[j];
+            }
+        }
+    }
+
+    dependenciesDirty = false;
+}
+
 }
@@ -2,10 +2,18 @@
 
 #include "Event.h"
 #include "Entity.h"
+#include "View.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
 #include <vector>
 #include <unordered_map>
 #include <typeindex>
+#include <typeinfo>
 #include <memory>
+#include <memory_resource>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
 
 namespace Mix
 {
@@ -17,32 +25,98 @@ class World;
 class System
 {
 public:
+    // the entity list allocates from the memory resource of the SystemManager adding the system (the default resource otherwise)
+    System();
     virtual ~System() {}
 
-    // what component types the system requires of entities (we can use this method in the constructor for example)
+    // processes the entities, called by SystemManager::update (or by hand)
+    virtual void update() {}
+
+    /*
+        What component types the system requires of entities (we can use this method in the constructor for example).
+        requireComponent<const T>() declares that the system only reads T, requireComponent<T>() that it may also write to T.
+        SystemManager::update runs systems in parallel when their declared reads and writes don't conflict.
+    */
     template <typename T>
     void requireComponent();
 
+    // declares access to a component type without requiring it of the system's entities (e.g. when reading other entities' components)
+    template <typename T>
+    void accessComponent();
+
     // returns a list of entities that the system should process each frame
-    std::vector<Entity> getEntities() { return entities; }
+    const std::pmr::vector<Entity>& getEntities() const { return entities; }
+
+    /*
+        Calls f(Entity, T& ...) or f(T& ...) for the system's entities in parallel on the world's thread pool,
+        in batches of grainSize consecutive entities of the list. T must be components the system requires. Returns when all entities are processed.
+        f may emit events and record commands (see EventManager, CommandBuffer).
+    */
+    template <typename ... T, typename F>
+    void parallelEach(F &&f, unsigned int grainSize = DEFAULT_GRAIN_SIZE);
 
     // adds an entity of interest
     void addEntity(Entity e);
 
     // if the entity is not alive anymore (during processing), the entity should be removed
+    // (the last entity of the list takes its place)
     void removeEntity(Entity e);
 
+    // checks whether the entity is in the system's list
+    bool hasEntity(Entity e) const;
+
     const ComponentMask& getComponentMask() const { return componentMask; }
+    const ComponentMask& getReadMask() const { return readMask; }
+    const ComponentMask& getWriteMask() const { return writeMask; }
+
+    // the type name of the system (typeid), e.g. for profiling
+    const char* getName() const { return name; }
 
 protected:
     World& getWorld() const;
 
 private:
+    void setWorld(World &world);
+
+    // Sets the memory resource that systems constructed on the calling thread allocate from, for as long as the scope lives.
+    class ResourceScope
+    {
+    public:
+        ResourceScope(std::pmr::memory_resource *resource);
+        ~ResourceScope();
+
+        ResourceScope(const ResourceScope&) = delete;
+        ResourceScope& operator=(const ResourceScope&) = delete;
+
+    private:
+        std::pmr::memory_resource *previousResource;
+    };
+
+    EntityManager& getEntityManager() const;
+    EventManager& getEventManager() const;
+    ThreadPool& getThreadPool() const;
+
+    // starts a concurrent phase of the world unless one is running, returns whether it did
+    bool beginConcurrentPhase();
+    void endConcurrentPhase();
+
+    // releases the memory of the entity list that isn't needed anymore
+    void compact();
+
     // which components an entity must have in order for the system to process the entity
     ComponentMask componentMask;
 
+    // which components the system reads and writes (a system that declares neither is assumed to touch everything)
+    ComponentMask readMask;
+    ComponentMask writeMask;
+
     // vector of all entities that the system is interested in
-    std::vector<Entity> entities;
+    std::pmr::vector<Entity> entities;
+
+    // entity index -> position in entities
+    SparseIndex entityPositions;
+
+    const char *name = "";
 
     World *world = nullptr;
     friend class SystemManager;
@@ -51,7 +125,8 @@ private:
 class SystemManager
 {
 public:
-    SystemManager(World &world) : world(world) {}
+    // systems and their entity lists are allocated from the memory resource
+    SystemManager(World &world, std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : resource(resource), world(world) {}
 
     template <typename T>
     void addSystem();
@@ -71,20 +146,118 @@ public:
     // adds an entity to each system that is interested of the entity
     void addToSystems(Entity e);
 
+    // adds entities to the systems that are interested, consecutive entities with the same component mask are routed together
+    void addToSystems(const Entity *first, const Entity *last);
+
     // removes an entity from interested systems' entity lists
     void removeFromSystems(Entity e);
+    void removeFromSystems(const Entity *first, const Entity *last);
+
+    // adds/removes an entity whose components changed to/from the systems that require any of the changed components
+    void refreshSystems(Entity e, const ComponentMask &changedComponents);
+
+    // releases the memory of the systems' entity lists that isn't needed anymore, and forgets the cached matches
+    void compact();
+
+    /*
+        Updates all systems. Systems whose declared component reads/writes conflict run in the order they were added,
+        the others run at the same time on the world's thread pool.
+        Systems running in parallel must only touch the components they declared, and must create/destroy entities and add/remove components
+        through the world's command buffer. Events emitted by the systems are merged in system order.
+    */
+    void update();
 
 private:
+    // updates the system at the position in the update order (and profiles it)
+    void updateSystem(unsigned int i);
+
+    void addToUpdateOrder(System *system);
+
+    // returns the systems interested in entities with the component mask (cached per distinct mask)
+    const std::vector<System*>& getMatchingSystems(const ComponentMask &mask);
+
+    // rebuilds the component index, and forgets the cached matches, after systems were added/removed
+    void buildMatching();
+
+    // builds the dependency graph of the systems from their declared component reads/writes
+    void buildDependencies();
+
     std::unordered_map<std::type_index, std::shared_ptr<System>> systems;
 
+    // systems in the order they were added
+    std::vector<System*> updateOrder;
+
+    // vector index = position in updateOrder, the systems that have to wait for that system to finish
+    std::vector<std::vector<unsigned int>> dependents;
+
+    // vector index = position in updateOrder, the number of systems that system has to wait for
+    std::vector<unsigned int> dependencyCounts;
+
+    bool dependenciesDirty = true;
+
+    // vector index = component id, the systems that require that component
+    std::vector<std::vector<System*>> systemsByComponent;
+
+    // entity component mask -> the systems interested in entities with that mask
+    std::unordered_map<ComponentMask, std::vector<System*>> matchingSystems;
+
+    bool matchingDirty = true;
+
+    std::pmr::memory_resource *resource;
+
     World &world;
 };
 
 template <typename T>
 void System::requireComponent()
 {
-    const auto componentId = Component<T>::getId();
+    const auto componentId = Component<std::remove_const_t<T>>::getId();
     componentMask.set(componentId);
+    accessComponent<T>();
+}
+
+template <typename ... T, typename F>
+void System::parallelEach(F &&f, unsigned int grainSize)
+{
+    grainSize = std::max(grainSize, 1u);
+
+    auto view = getEntityManager().view<T...>();
+    const auto *first = entities.data();
+
+    // batches emit events and record commands concurrently (SystemManager::update has already started a concurrent phase when systems run in parallel)
+    const auto ownPhase = beginConcurrentPhase();
+
+    // every batch gets a key of its own, later calls get larger keys
+    const auto source = EventManager::getEmitSource();
+    const auto firstBatch = getEventManager().reserveBatches((entities.size() + grainSize - 1) / grainSize);
+    try {
+        getThreadPool().parallelFor(entities.size(), grainSize, [&view, &f, first, source, firstBatch, grainSize](unsigned int begin, unsigned int end) {
+            EventManager::EmitScope scope(source, firstBatch + begin / grainSize);
+            view.each(first + begin, first + end, f);
+        });
+    }
+    catch (...) {
+        if (ownPhase) {
+            endConcurrentPhase();
+        }
+        throw;
+    }
+
+    if (ownPhase) {
+        endConcurrentPhase();
+    }
+}
+
+template <typename T>
+void System::accessComponent()
+{
+    const auto componentId = Component<std::remove_const_t<T>>::getId();
+    if (std::is_const<T>::value) {
+        readMask.set(componentId);
+    }
+    else {
+        writeMask.set(componentId);
+    }
 }
 
 template <typename T>
@@ -94,9 +267,12 @@ void SystemManager::addSystem()
         return;
     }
 
-    std::shared_ptr<T> system(new T);
-    system->world = &world;
+    System::ResourceScope scope(resource);
+    auto system = std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource));
+    system->name = typeid(T).name();
+    system->setWorld(world);
     systems.insert(std::make_pair(std::type_index(typeid(T)), system));
+    addToUpdateOrder(system.get());
 }
 
 template <typename T, typename ... Args>
@@ -106,9 +282,12 @@ void SystemManager::addSystem(Args && ... args)
         return;
     }
 
-    std::shared_ptr<T> system(new T(std::forward<Args>(args) ...));
-    system->world = &world;
+    System::ResourceScope scope(resource);
+    auto system = std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource), std::forward<Args>(args) ...);
+    system->name = typeid(T).name();
+    system->setWorld(world);
     systems.insert(std::make_pair(std::type_index(typeid(T)), system));
+    addToUpdateOrder(system.get());
 }
 
 template <typename T>
@@ -119,6 +298,9 @@ void SystemManager::removeSystem()
     }
 
     auto it = systems.find(std::type_index(typeid(T)));
+    updateOrder.erase(std::find(updateOrder.begin(), updateOrder.end(), it->second.get()));
+    dependenciesDirty = true;
+    matchingDirty = true;
     systems.erase(it);
 }
 
@@ -0,0 +1,159 @@
+#include "ThreadPool.h"
+
+namespace Mix
+{
+
+namespace
+{
+
+thread_local unsigned int threadIndex = 0;
+thread_local const ThreadPool *currentPool = nullptr;
+
+}
+
+ThreadPool::ThreadPool(unsigned int workerCount)
+{
+    if (workerCount == 0) {
+        workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    for (unsigned int i = 0; i <= workerCount; ++i) {
+        queues.emplace_back(new Queue());
+    }
+
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned int ThreadPool::getThreadIndex()
+{
+    return threadIndex;
+}
+
+void ThreadPool::submit(TaskGroup &group, Task task)
+{
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+
+    auto &queue = *queues[getQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ &group, std::move(task) });
+    }
+    queuedTasks.fetch_add(1, std::memory_order_release);
+
+    // taking the lock makes sure a worker that is about to sleep sees the new task
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    condition.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup &group)
+{
+    const auto index = getQueueIndex();
+    while (!group.isDone()) {
+        if (!runQueuedTask(index)) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lock(group.exceptionMutex);
+        std::swap(exception, group.exception);
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void ThreadPool::TaskGroup::setException(std::exception_ptr exception)
+{
+    std::lock_guard<std::mutex> lock(exceptionMutex);
+    if (!this->exception) {
+        this->exception = exception;
+    }
+}
+
+void ThreadPool::work(unsigned int index)
+{
+    threadIndex = index;
+    currentPool = this;
+
+    for (;;) {
+        if (runQueuedTask(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        condition.wait(lock, [this] { return stopping || queuedTasks.load(std::memory_order_acquire) > 0; });
+        if (stopping && queuedTasks.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+unsigned int ThreadPool::getQueueIndex() const
+{
+    return currentPool == this ? threadIndex : 0;
+}
+
+bool ThreadPool::runQueuedTask(unsigned int index)
+{
+    QueuedTask queuedTask;
+    bool found = false;
+
+    // newest task of our own queue first (it's likely to still be in cache)
+    {
+        auto &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            queuedTask = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // otherwise steal the oldest task of another queue
+    for (std::size_t i = 1; !found && i < queues.size(); ++i) {
+        auto &queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            queuedTask = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+
+    // an exception is kept for wait to rethrow (it mustn't leave a worker thread, and the task has to count as finished)
+    try {
+        queuedTask.task();
+    }
+    catch (...) {
+        queuedTask.group->setException(std::current_exception());
+    }
+    queuedTask.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+}
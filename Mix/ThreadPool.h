@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Config.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+namespace Mix
+{
+
+/*
+    A fixed set of worker threads that run submitted tasks.
+    Every thread has its own task queue: a thread takes the task it queued last from its own queue,
+    and when that is empty it steals the oldest task of another thread's queue.
+*/
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // Counts the unfinished tasks submitted with it, so that they can be waited on together.
+    class TaskGroup
+    {
+    public:
+        bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        // keeps the first exception a task of the group threw
+        void setException(std::exception_ptr exception);
+
+        std::atomic<int> pending{0};
+        std::mutex exceptionMutex;
+        std::exception_ptr exception;
+        friend class ThreadPool;
+    };
+
+    // workerCount = 0 creates one worker less than the hardware has threads (the calling thread helps out when waiting)
+    explicit ThreadPool(unsigned int workerCount = WORKER_THREADS);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int getWorkerCount() const { return workers.size(); }
+
+    // returns 0 for threads that aren't workers of a pool, or 1..worker count for the pool's workers
+    static unsigned int getThreadIndex();
+
+    // queues a task, it's safe to submit tasks from within other tasks
+    void submit(TaskGroup &group, Task task);
+
+    /*
+        Runs queued tasks on the calling thread until every task of the group has finished.
+        A task that throws still counts as finished, and the first exception thrown by a task of the group is rethrown here.
+    */
+    void wait(TaskGroup &group);
+
+    /*
+        Splits [0, count) into batches of grainSize and calls f(begin, end) for each batch in parallel.
+        Returns when all batches are done, the calling thread runs batches too. Rethrows the first exception f threw.
+    */
+    template <typename F>
+    void parallelFor(unsigned int count, unsigned int grainSize, F &&f);
+
+private:
+    struct QueuedTask
+    {
+        TaskGroup *group;
+        Task task;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+    };
+
+    void work(unsigned int index);
+    unsigned int getQueueIndex() const;
+    bool runQueuedTask(unsigned int index);
+
+    std::vector<std::thread> workers;
+
+    // vector index = thread index (0 is shared by all threads that aren't workers)
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    // number of tasks in all queues, lets idle workers sleep
+    std::atomic<int> queuedTasks{0};
+    std::mutex sleepMutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
+
+template <typename F>
+void ThreadPool::parallelFor(unsigned int count, unsigned int grainSize, F &&f)
+{
+    grainSize = std::max(grainSize, 1u);
+    if (count <= grainSize) {
+        f(0u, count);
+        return;
+    }
+
+    TaskGroup group;
+    for (unsigned int begin = grainSize; begin < count; begin += grainSize) {
+        const auto end = std::min(begin + grainSize, count);
+        submit(group, [&f, begin, end] { f(begin, end); });
+    }
+
+    // the other batches refer to f and group, so they have to finish before an exception leaves
+    try {
+        f(0u, grainSize);
+    }
+    catch (...) {
+        group.setException(std::current_exception());
+    }
+    wait(group);
+}
+
+}
@@ -0,0 +1,58 @@
+#include "TypeRegistry.h"
+#include <cassert>
+
+namespace Mix
+{
+
+TypeRegistry::TypeRegistry(unsigned int capacity, unsigned int reservedCount)
+    : types(new std::atomic<const TypeInfo*>[capacity]), nextId(reservedCount), capacity(capacity), reservedCount(reservedCount)
+{
+    assert(reservedCount <= capacity);
+
+    for (unsigned int i = 0; i < capacity; ++i) {
+        types[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+unsigned int TypeRegistry::add(const TypeInfo &info, unsigned int fixedId)
+{
+    auto id = fixedId;
+    if (id == NoId) {
+        id = nextId.fetch_add(1, std::memory_order_relaxed);
+        assert(id < capacity && "too many types, raise the maximum in Config.h");
+    }
+    else {
+        assert(id < reservedCount && "fixed ids must be below the reserved count in Config.h");
+    }
+
+    // a fixed id can only be taken once
+    const TypeInfo *expected = nullptr;
+    const auto added = types[id].compare_exchange_strong(expected, &info, std::memory_order_acq_rel);
+    assert(added && "two types have the same fixed id");
+    (void)added;
+
+    return id;
+}
+
+const TypeInfo* TypeRegistry::get(unsigned int id) const
+{
+    return id < capacity ? types[id].load(std::memory_order_acquire) : nullptr;
+}
+
+unsigned int TypeRegistry::find(std::uint64_t stableId) const
+{
+    if (stableId == 0) {
+        return NoId;
+    }
+
+    for (unsigned int id = 0; id < capacity; ++id) {
+        const auto *info = types[id].load(std::memory_order_acquire);
+        if (info && info->stableId == stableId) {
+            return id;
+        }
+    }
+
+    return NoId;
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace Mix
+{
+
+/*
+    Specialize to give a component type a fixed id and/or a name (both are optional):
+
+    template <>
+    struct Mix::ComponentTraits<PositionComponent>
+    {
+        static const unsigned int id = 0;                       // must be below RESERVED_COMPONENT_IDS (see Config.h)
+        static constexpr const char *name = "Position";
+    };
+
+    Types without a fixed id get the next free id above the reserved ones when they're first used, so their ids depend on
+    the order of first use. Fixed ids are the same in every run, and so are names, which are hashed into TypeInfo::stableId
+    (e.g. to key serialized or replicated data when not every type has a fixed id).
+*/
+template <typename T>
+struct ComponentTraits {};
+
+// Same as ComponentTraits, for event types (fixed ids must be below RESERVED_EVENT_IDS).
+template <typename T>
+struct EventTraits {};
+
+// What storage and serialization need to know about a type.
+struct TypeInfo
+{
+    std::size_t size;
+    std::size_t alignment;
+
+    // objects can be copied with memcpy
+    bool isTriviallyCopyable;
+
+    // from the type's traits, null if it has no name
+    const char *name;
+
+    // FNV-1a hash of the name, the same on every machine (0 if the type has no name)
+    std::uint64_t stableId;
+
+    template <typename T, typename Traits>
+    static constexpr TypeInfo make()
+    {
+        return { sizeof(T), alignof(T), std::is_trivially_copyable<T>::value, getName<Traits>(0), hash(getName<Traits>(0)) };
+    }
+
+    static constexpr std::uint64_t hash(const char *name)
+    {
+        std::uint64_t hash = 0;
+        if (name) {
+            hash = 14695981039346656037ull;
+            for (; *name; ++name) {
+                hash = (hash ^ std::uint8_t(*name)) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+private:
+    template <typename Traits>
+    static constexpr auto getName(int) -> decltype(Traits::name, (const char*)nullptr) { return Traits::name; }
+
+    template <typename Traits>
+    static constexpr const char* getName(long) { return nullptr; }
+};
+
+/*
+    Hands out the ids of one kind of type (components or events) and keeps the info of each type by id.
+    Ids are assigned lock-free, so types can be used for the first time from many threads at once.
+*/
+class TypeRegistry
+{
+public:
+    static const unsigned int NoId = ~0u;
+
+    // ids below reservedCount are only given to types with a fixed id
+    TypeRegistry(unsigned int capacity, unsigned int reservedCount);
+
+    TypeRegistry(const TypeRegistry&) = delete;
+    TypeRegistry& operator=(const TypeRegistry&) = delete;
+
+    // registers the type with the fixed id of its traits (or the next free id if it has none) and returns the id
+    template <typename Traits>
+    unsigned int add(const TypeInfo &info)
+    {
+        return add(info, getFixedId<Traits>(0));
+    }
+
+    // returns the info of the type with the id, null if no type has that id (yet)
+    const TypeInfo* get(unsigned int id) const;
+
+    // returns the id of the registered type whose name hashes to stableId, NoId if there is none
+    unsigned int find(std::uint64_t stableId) const;
+
+    unsigned int getCapacity() const { return capacity; }
+
+private:
+    unsigned int add(const TypeInfo &info, unsigned int fixedId);
+
+    template <typename Traits>
+    static constexpr auto getFixedId(int) -> decltype(Traits::id, 0u) { return Traits::id; }
+
+    template <typename Traits>
+    static constexpr unsigned int getFixedId(long) { return NoId; }
+
+    // indexed by id
+    std::unique_ptr<std::atomic<const TypeInfo*>[]> types;
+    std::atomic<unsigned int> nextId;
+    unsigned int capacity;
+    unsigned int reservedCount;
+};
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "Entity.h"
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+namespace Mix
+{
+
+/*
+    A view iterates all entities that have the components T and hands out references straight into the component storage,
+    so no entity list is copied and no pool is looked up (or ref counted) per entity.
+    Components can be requested as const, e.g. View<PositionComponent, const VelocityComponent>.
+
+    Example:
+
+    getWorld().getEntityManager().view<PositionComponent, const VelocityComponent>().each(
+        [](Entity e, PositionComponent &position, const VelocityComponent &velocity) { ... });
+
+    Note that the view sees entities as soon as they have the components (not after the next world update like systems do),
+    and that components of the viewed types must not be added or removed while iterating.
+*/
+template <typename ... T>
+class View
+{
+public:
+    View(EntityManager &entityManager);
+
+    // calls f(Entity, T& ...), f(EntityRef, T& ...) or f(T& ...) for each entity that has all components T
+    template <typename F>
+    void each(F &&f);
+
+    // calls f(Entity, T& ...), f(EntityRef, T& ...) or f(T& ...) for each entity in [first, last), the entities must have all components T
+    template <typename F>
+    void each(const Entity *first, const Entity *last, F &&f);
+
+private:
+    template <typename U>
+    using Storage = SparsePool<std::remove_const_t<U>>;
+
+    template <typename F, std::size_t ... I>
+    void eachSparse(F &f, std::index_sequence<I...>);
+
+    template <std::size_t Driver, typename F, std::size_t ... I>
+    void eachDriven(F &f, std::index_sequence<I...>);
+
+    template <typename F>
+    void eachArchetype(F &f);
+
+    template <typename F, std::size_t ... I>
+    void eachOf(F &f, const Entity *first, const Entity *last, std::index_sequence<I...>);
+
+    template <typename F, typename ... U>
+    void eachRow(F &f, unsigned int count, const std::uint32_t *indices, U * ... columns);
+
+    // returns the component of the entity from the I:th pool, or the packed component at position i if the I:th pool drives the iteration
+    template <std::size_t I, std::size_t Driver>
+    decltype(auto) getComponent(std::uint32_t index, unsigned int i);
+
+    template <typename F>
+    void invoke(F &f, std::uint32_t index, T & ... components);
+
+    EntityManager &entityManager;
+    ComponentMask mask;
+    std::tuple<Storage<T>*...> pools;
+};
+
+template <typename ... T>
+View<T...> EntityManager::view()
+{
+    return View<T...>(*this);
+}
+
+template <typename ... T>
+View<T...>::View(EntityManager &entityManager) : entityManager(entityManager)
+{
+    (mask.set(Component<std::remove_const_t<T>>::getId()), ...);
+
+    if (entityManager.storageMode == StorageMode::Sparse) {
+        auto getPool = [&entityManager](BaseComponent::Id componentId) {
+            return componentId < entityManager.componentPools.size() ? entityManager.componentPools[componentId].get() : nullptr;
+        };
+        pools = std::make_tuple(static_cast<Storage<T>*>(getPool(Component<std::remove_const_t<T>>::getId())) ...);
+    }
+}
+
+template <typename ... T>
+template <typename F>
+void View<T...>::each(F &&f)
+{
+    if (entityManager.storageMode == StorageMode::Archetype) {
+        eachArchetype(f);
+    }
+    else {
+        eachSparse(f, std::index_sequence_for<T...>());
+    }
+}
+
+template <typename ... T>
+template <typename F>
+void View<T...>::each(const Entity *first, const Entity *last, F &&f)
+{
+    eachOf(f, first, last, std::index_sequence_for<T...>());
+}
+
+template <typename ... T>
+template <typename F, std::size_t ... I>
+void View<T...>::eachSparse(F &f, std::index_sequence<I...> sequence)
+{
+    // nothing to iterate if any of the component types has never been added
+    if (((std::get<I>(pools) == nullptr) || ...)) {
+        return;
+    }
+
+    // iterate the smallest pool and look up the other components of each entity
+    const unsigned int sizes[] = { std::get<I>(pools)->getSize() ... };
+    std::size_t driver = 0;
+    for (std::size_t i = 1; i < sizeof...(T); ++i) {
+        if (sizes[i] < sizes[driver]) {
+            driver = i;
+        }
+    }
+
+    ((driver == I ? eachDriven<I>(f, sequence) : void()), ...);
+}
+
+template <typename ... T>
+template <std::size_t Driver, typename F, std::size_t ... I>
+void View<T...>::eachDriven(F &f, std::index_sequence<I...>)
+{
+    const auto *driver = std::get<Driver>(pools);
+    const auto size = driver->getSize();
+
+    for (unsigned int i = 0; i < size; ++i) {
+        const auto index = driver->getIndex(i);
+        if (!entityManager.componentMasks[index].includes(mask)) {
+            continue;
+        }
+
+        invoke(f, index, getComponent<I, Driver>(index, i) ...);
+    }
+}
+
+template <typename ... T>
+template <typename F>
+void View<T...>::eachArchetype(F &f)
+{
+    for (auto &it : entityManager.archetypes) {
+        auto &archetype = *it.second;
+        if (!archetype.getMask().includes(mask)) {
+            continue;
+        }
+
+        for (unsigned int chunk = 0; chunk < archetype.getChunkCount(); ++chunk) {
+            eachRow(f, archetype.getChunkSize(chunk), archetype.getIndices(chunk),
+                archetype.template getColumn<std::remove_const_t<T>>(chunk) ...);
+        }
+    }
+}
+
+template <typename ... T>
+template <typename F, std::size_t ... I>
+void View<T...>::eachOf(F &f, const Entity *first, const Entity *last, std::index_sequence<I...>)
+{
+    if (entityManager.storageMode == StorageMode::Archetype) {
+        for (auto it = first; it != last; ++it) {
+            const auto index = it->getIndex();
+            assert(entityManager.componentMasks[index].includes(mask));
+            const auto &location = entityManager.entityLocations[index];
+            invoke(f, index, location.archetype->template get<std::remove_const_t<T>>(location.row) ...);
+        }
+    }
+    else {
+        for (auto it = first; it != last; ++it) {
+            const auto index = it->getIndex();
+            assert(entityManager.componentMasks[index].includes(mask));
+            invoke(f, index, std::get<I>(pools)->get(index) ...);
+        }
+    }
+}
+
+template <typename ... T>
+template <typename F, typename ... U>
+void View<T...>::eachRow(F &f, unsigned int count, const std::uint32_t *indices, U * ... columns)
+{
+    for (unsigned int i = 0; i < count; ++i) {
+        invoke(f, indices[i], columns[i] ...);
+    }
+}
+
+template <typename ... T>
+template <std::size_t I, std::size_t Driver>
+decltype(auto) View<T...>::getComponent(std::uint32_t index, unsigned int i)
+{
+    if constexpr (I == Driver) {
+        return (std::get<I>(pools)->getPacked(i));
+    }
+    else {
+        return (std::get<I>(pools)->get(index));
+    }
+}
+
+template <typename ... T>
+template <typename F>
+void View<T...>::invoke(F &f, std::uint32_t index, T & ... components)
+{
+    if constexpr (std::is_invocable_v<F&, Entity, T&...>) {
+        f(Entity(index, entityManager.ids.getVersion(index)), components ...);
+    }
+    else if constexpr (std::is_invocable_v<F&, EntityRef, T&...>) {
+        f(EntityRef(Entity(index, entityManager.ids.getVersion(index)), entityManager), components ...);
+    }
+    else {
+        f(components ...);
+    }
+}
+
+}
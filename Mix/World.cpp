@@ -1,14 +1,23 @@
 #include "World.h"
+#include <algorithm>
 #include <cassert>
 
 namespace Mix
 {
 
-World::World()
+World::World(StorageMode storageMode, std::pmr::memory_resource *resource)
+    : resource(resource), frameBuffer(resource->allocate(FRAME_ARENA_SIZE)), frameResource(frameBuffer, FRAME_ARENA_SIZE, resource)
 {
-    entityManager = std::make_unique<EntityManager>(*this);
-    systemManager = std::make_unique<SystemManager>(*this);
-    eventManager = std::make_unique<EventManager>(*this);
+    entityManager = std::make_unique<EntityManager>(*this, storageMode, resource);
+    systemManager = std::make_unique<SystemManager>(*this, resource);
+    eventManager = std::make_unique<EventManager>(*this, resource);
+    commandBuffer = std::make_unique<CommandBuffer>(*this, resource);
+}
+
+World::~World()
+{
+    // the arena never frees its initial buffer itself
+    resource->deallocate(frameBuffer, FRAME_ARENA_SIZE);
 }
 
 EntityManager& World::getEntityManager() const
@@ -29,27 +38,94 @@ EventManager& World::getEventManager() const
     return *eventManager;
 }
 
+CommandBuffer& World::getCommandBuffer() const
+{
+    assert(commandBuffer != nullptr);
+    return *commandBuffer;
+}
+
+ThreadPool& World::getThreadPool() const
+{
+    // threads might use the pool for the first time at once
+    std::call_once(threadPoolCreated, [this] { threadPool = std::make_unique<ThreadPool>(); });
+    return *threadPool;
+}
+
+void World::beginConcurrentPhase()
+{
+    const auto threadCount = getThreadPool().getWorkerCount() + 1;
+    getEventManager().beginConcurrentPhase(threadCount);
+    getCommandBuffer().setThreadCount(threadCount);
+}
+
+void World::endConcurrentPhase()
+{
+    getEventManager().endConcurrentPhase();
+}
+
+bool World::isConcurrentPhase() const
+{
+    return getEventManager().isConcurrentPhase();
+}
+
 void World::update()
 {
-    for (auto e : createdEntities) {
-        getSystemManager().addToSystems(e);
-    }
+    const auto start = PROFILING ? Profiler::get().now() : 0;
+
+    getCommandBuffer().playback();
+    const auto createdCount = createdEntities.size();
+
+    getSystemManager().addToSystems(createdEntities.data(), createdEntities.data() + createdEntities.size());
     createdEntities.clear();
 
-    for (auto e : destroyedEntities) {
-        getSystemManager().removeFromSystems(e);
-        getEntityManager().destroyEntity(e);
+    // entities that got or lost components since the last update
+    for (const auto &changedEntity : getEntityManager().getChangedEntities()) {
+        getSystemManager().refreshSystems(changedEntity.entity, changedEntity.changedComponents);
     }
+    getEntityManager().clearChangedEntities();
+
+    // an entity might have been destroyed more than once
+    auto &entityManager = getEntityManager();
+    destroyedEntities.erase(std::remove_if(destroyedEntities.begin(), destroyedEntities.end(),
+        [&entityManager](Entity e) { return !entityManager.isEntityAlive(e); }
+    ), destroyedEntities.end());
+    std::sort(destroyedEntities.begin(), destroyedEntities.end());
+    destroyedEntities.erase(std::unique(destroyedEntities.begin(), destroyedEntities.end()), destroyedEntities.end());
+
+    const auto *first = destroyedEntities.data();
+    const auto *last = first + destroyedEntities.size();
+    getSystemManager().removeFromSystems(first, last);
+    entityManager.destroyEntities(first, last);
+    const auto destroyedCount = destroyedEntities.size();
     destroyedEntities.clear();
 
-    getEventManager().destroyEvents();
+    getEventManager().dispatchEvents();
+    const auto eventCount = getEventManager().getEmittedCount();
+    getEventManager().swapEvents();
+
+    // back to the initial buffer (memory the arena grew by goes back to the world's memory resource)
+    frameResource.release();
+
+    if (PROFILING) {
+        auto &profiler = Profiler::get();
+        profiler.recordFrame(start, profiler.now(), createdCount, destroyedCount, eventCount);
+    }
 }
 
-Entity World::createEntity()
+void World::compact()
+{
+    assert(!isConcurrentPhase());
+
+    getEntityManager().compact();
+    getSystemManager().compact();
+    getEventManager().compact();
+}
+
+EntityRef World::createEntity()
 {
     auto e = getEntityManager().createEntity();
     createdEntities.push_back(e);
-    return e;
+    return getEntityRef(e);
 }
 
 void World::destroyEntity(Entity e)
@@ -57,12 +133,46 @@ void World::destroyEntity(Entity e)
     destroyedEntities.push_back(e);
 }
 
-Entity World::getEntity(std::string tag) const
+std::vector<Entity> World::createEntities(unsigned int count)
+{
+    std::vector<Entity> entities;
+    getEntityManager().createEntities(count, entities);
+    createdEntities.insert(createdEntities.end(), entities.begin(), entities.end());
+    return entities;
+}
+
+std::vector<Entity> World::createEntities(unsigned int count, Entity prototype)
+{
+    std::vector<Entity> entities;
+    getEntityManager().createEntities(count, prototype, entities);
+    createdEntities.insert(createdEntities.end(), entities.begin(), entities.end());
+    return entities;
+}
+
+std::vector<Entity> World::instantiate(const Prefab &prefab, unsigned int count)
+{
+    std::vector<Entity> entities;
+    getEntityManager().instantiate(prefab, count, entities);
+    createdEntities.insert(createdEntities.end(), entities.begin(), entities.end());
+    return entities;
+}
+
+void World::destroyEntities(const std::vector<Entity> &entities)
+{
+    destroyedEntities.insert(destroyedEntities.end(), entities.begin(), entities.end());
+}
+
+EntityRef World::getEntity(Symbol tag) const
+{
+    return getEntityRef(getEntityManager().getEntityByTag(tag));
+}
+
+EntityRef World::getEntityRef(Entity e) const
 {
-    return getEntityManager().getEntityByTag(tag);
+    return getEntityManager().getEntityRef(e);
 }
 
-std::vector<Entity> World::getGroup(std::string group) const
+const std::pmr::vector<Entity>& World::getGroup(Symbol group) const
 {
     return getEntityManager().getEntityGroup(group);
 }
@@ -7,9 +7,15 @@
 #include "Entity.h"
 #include "System.h"
 #include "Event.h"
+#include "Prefab.h"
+#include "CommandBuffer.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
 #include <vector>
 #include <string>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 
 namespace Mix
 {
@@ -18,26 +24,89 @@ namespace Mix
 class World
 {
 public:
-    World();
+    /*
+        Everything the world stores (component pools, archetype chunks, event buffers, system entity lists, groups...) is allocated
+        from the memory resource, which must outlive the world. It must be thread-safe if systems run in parallel
+        (e.g. std::pmr::synchronized_pool_resource, or the default new/delete resource).
+    */
+    World(StorageMode storageMode = StorageMode::Sparse, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+    ~World();
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    std::pmr::memory_resource* getMemoryResource() const { return resource; }
+
+    /*
+        An arena for scratch data that only has to live for a frame: everything allocated from it is released at once when
+        update returns (deallocating does nothing). Starts out with FRAME_ARENA_SIZE bytes and grows from the world's memory resource.
+        Not thread-safe, only use it from the thread that updates the world and not during a concurrent phase.
+    */
+    std::pmr::memory_resource& getFrameResource() { return frameResource; }
 
     EntityManager& getEntityManager() const;
     SystemManager& getSystemManager() const;
     EventManager& getEventManager() const;
 
+    // structural changes recorded by systems, played back at the start of update
+    CommandBuffer& getCommandBuffer() const;
+
+    // the worker threads used to update systems in parallel (started on first use)
+    ThreadPool& getThreadPool() const;
+
+    /*
+        Called around work that runs on the thread pool (systems updated in parallel, System::parallelEach),
+        lets the worker threads emit events and record commands. Phases don't nest, check isConcurrentPhase first.
+    */
+    void beginConcurrentPhase();
+    void endConcurrentPhase();
+    bool isConcurrentPhase() const;
+
     /*
-        Updates the systems so that created/deleted entities are removed from the systems' vectors of entities.
+        Plays back the commands recorded in the command buffer.
+        Updates the systems so that created/deleted entities are added to/removed from the systems' vectors of entities,
+        and so that entities whose components were added/removed are added to/removed from the systems that are (no longer) interested.
         Updates the entity manager so that the version of a destructed entity's index is incremented.
-        Destroys all the events that were created during the last frame.
+        Dispatches the events emitted during the last frame to deferred handlers, destroys the events that were readable during the last frame
+        and makes the events emitted during the last frame readable. Releases the frame arena.
+        With PROFILING set in Config.h, the time it took and the number of entities created/destroyed and events emitted are recorded (see Profiler).
     */
     void update();
 
-    Entity createEntity();
+    /*
+        Releases memory kept around for entities, components and events that are gone, e.g. after a mass despawn
+        (storage otherwise keeps its peak size so that steady traffic doesn't allocate). Best called right after update,
+        not during a concurrent phase.
+    */
+    void compact();
+
+    EntityRef createEntity();
     void destroyEntity(Entity e);
 
-    Entity getEntity(std::string tag) const;
-    std::vector<Entity> getGroup(std::string group) const;
+    /*
+        Creates/destroys many entities at once (like createEntity/destroyEntity they are created/destroyed on the next update).
+        With a prototype, each created entity gets a copy of the prototype's components.
+    */
+    std::vector<Entity> createEntities(unsigned int count);
+    std::vector<Entity> createEntities(unsigned int count, Entity prototype);
+    void destroyEntities(const std::vector<Entity> &entities);
+
+    // creates count entities with the prefab's components (created on the next update, like createEntity)
+    std::vector<Entity> instantiate(const Prefab &prefab, unsigned int count = 1);
+
+    EntityRef getEntity(Symbol tag) const;
+
+    // returns the entity along with the world's entity manager, for convenience (see EntityRef)
+    EntityRef getEntityRef(Entity e) const;
+    const std::pmr::vector<Entity>& getGroup(Symbol group) const;
 
 private:
+    std::pmr::memory_resource *resource;
+
+    // the initial buffer of the frame arena (allocated from resource)
+    void *frameBuffer;
+    std::pmr::monotonic_buffer_resource frameResource;
+
     // vector of entities that are awaiting creation
     std::vector<Entity> createdEntities;
 
@@ -47,6 +116,9 @@ private:
     std::unique_ptr<EntityManager> entityManager = nullptr;
     std::unique_ptr<SystemManager> systemManager = nullptr;
     std::unique_ptr<EventManager> eventManager = nullptr;
+    std::unique_ptr<CommandBuffer> commandBuffer = nullptr;
+    mutable std::unique_ptr<ThreadPool> threadPool = nullptr;
+    mutable std::once_flag threadPoolCreated;
 };
 
 }